@@ -0,0 +1,494 @@
+#include "async_reader.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define THUMBNAIL_HAVE_IO_URING 1
+#endif
+#endif
+
+// ---------------------------------------------------------------------------
+// Minimal io_uring wrapper (raw syscalls, no liburing dependency)
+// ---------------------------------------------------------------------------
+
+struct AsyncReader::Ring {
+#ifdef THUMBNAIL_HAVE_IO_URING
+    int ring_fd = -1;
+
+    void* sq_ptr = nullptr;
+    size_t sq_len = 0;
+    void* cq_ptr = nullptr;
+    size_t cq_len = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_len = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_entries = 0;
+    unsigned sqe_tail = 0;
+    unsigned to_submit = 0;
+
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    // One slot per read in flight; user_data is the slot index
+    struct Slot {
+        Request request;
+        BufferPool::Buffer* buffer = nullptr;
+        int fd = -1;
+        size_t done = 0;
+        bool used = false;
+    };
+    std::vector<Slot> slots;
+    std::vector<size_t> free_slots;
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0) {
+            return false;
+        }
+
+        sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_len = cq_len = (sq_len > cq_len) ? sq_len : cq_len;
+        }
+
+        sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            sq_ptr = nullptr;
+            return false;
+        }
+        if (single_mmap) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) {
+                cq_ptr = nullptr;
+                return false;
+            }
+        }
+
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes_ptr = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ring_fd, IORING_OFF_SQES);
+        if (sqes_ptr == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+        char* sq = static_cast<char*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries = params.sq_entries;
+        sqe_tail = *sq_tail;
+
+        char* cq = static_cast<char*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        slots.resize(entries);
+        for (size_t i = entries; i > 0; i--) {
+            free_slots.push_back(i - 1);
+        }
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqes_len);
+        }
+        if (cq_ptr != nullptr && cq_ptr != sq_ptr) {
+            munmap(cq_ptr, cq_len);
+        }
+        if (sq_ptr != nullptr) {
+            munmap(sq_ptr, sq_len);
+        }
+        if (ring_fd >= 0) {
+            close(ring_fd);
+        }
+    }
+
+    // Queue a read of the slot's remaining bytes
+    bool queueRead(size_t slot_index) {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sqe_tail - head >= sq_entries) {
+            return false;
+        }
+
+        Slot& slot = slots[slot_index];
+        size_t remaining = slot.buffer->size - slot.done;
+        unsigned index = sqe_tail & *sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = slot.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(slot.buffer->data.get() + slot.done);
+        sqe->len = static_cast<unsigned>(remaining < (1u << 30) ? remaining : (1u << 30));
+        sqe->off = slot.done;
+        sqe->user_data = slot_index;
+        sq_array[index] = index;
+        sqe_tail++;
+        to_submit++;
+        return true;
+    }
+
+    // Submit queued reads and wait for at least wait_nr completions
+    int submitAndWait(unsigned wait_nr) {
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        long ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, nullptr, 0);
+        if (ret < 0) {
+            return errno == EINTR ? 0 : -errno;
+        }
+        to_submit -= static_cast<unsigned>(ret);
+        return static_cast<int>(ret);
+    }
+
+    bool peek(io_uring_cqe& out) {
+        unsigned head = *cq_head;
+        if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        out = cqes[head & *cq_mask];
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// AsyncReader
+// ---------------------------------------------------------------------------
+
+AsyncReader::AsyncReader(ReaderBackend backend, int queue_depth, BufferPool& pool, Completion on_read)
+    : backend(backend), queue_depth(queue_depth > 0 ? queue_depth : 1), pool(pool),
+      on_read(std::move(on_read)), outstanding(0), stopping(false) {
+    if (this->backend == ReaderBackend::IoUring) {
+#ifdef THUMBNAIL_HAVE_IO_URING
+        ring.reset(new Ring());
+        if (!ring->init(this->queue_depth)) {
+            std::cerr << "io_uring unavailable (" << std::strerror(errno)
+                      << "), falling back to reader threads" << std::endl;
+            ring.reset();
+            this->backend = ReaderBackend::Threads;
+        }
+#else
+        std::cerr << "io_uring not supported on this platform, falling back to reader threads" << std::endl;
+        this->backend = ReaderBackend::Threads;
+#endif
+    }
+
+    if (this->backend == ReaderBackend::IoUring) {
+        threads.emplace_back(&AsyncReader::uringLoop, this);
+    } else {
+        this->backend = ReaderBackend::Threads;
+        for (int i = 0; i < this->queue_depth; i++) {
+            threads.emplace_back(&AsyncReader::threadLoop, this);
+        }
+    }
+}
+
+AsyncReader::~AsyncReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    request_cv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool AsyncReader::parseBackend(const std::string& name, ReaderBackend& backend) {
+    if (name == "direct") {
+        backend = ReaderBackend::Direct;
+    } else if (name == "threads") {
+        backend = ReaderBackend::Threads;
+    } else if (name == "uring") {
+        backend = ReaderBackend::IoUring;
+    } else if (name == "mmap") {
+        backend = ReaderBackend::Mmap;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* AsyncReader::getBackendName(ReaderBackend backend) {
+    switch (backend) {
+        case ReaderBackend::Threads: return "threads";
+        case ReaderBackend::IoUring: return "io_uring";
+        case ReaderBackend::Mmap: return "mmap";
+        default: return "direct";
+    }
+}
+
+ReaderBackend AsyncReader::getBackend() const {
+    return backend;
+}
+
+void AsyncReader::submit(Request request) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        space_cv.wait(lock, [this]() { return pending.size() < pool.getBufferCount(); });
+        pending.push_back(std::move(request));
+        outstanding++;
+    }
+    request_cv.notify_one();
+}
+
+bool AsyncReader::trySubmit(Request& request) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.size() >= pool.getBufferCount()) {
+            return false;
+        }
+        pending.push_back(std::move(request));
+        outstanding++;
+    }
+    request_cv.notify_one();
+    return true;
+}
+
+void AsyncReader::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained_cv.wait(lock, [this]() { return outstanding == 0; });
+}
+
+bool AsyncReader::popRequest(Request& request, bool block) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (block) {
+        request_cv.wait(lock, [this]() { return stopping || !pending.empty(); });
+    }
+    if (pending.empty()) {
+        return false;
+    }
+    request = std::move(pending.front());
+    pending.pop_front();
+    space_cv.notify_one();
+    return true;
+}
+
+void AsyncReader::pushFront(Request request) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_front(std::move(request));
+}
+
+void AsyncReader::complete(Request request, BufferPool::Buffer* buffer) {
+    on_read(std::move(request), buffer);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--outstanding == 0) {
+        drained_cv.notify_all();
+    }
+}
+
+bool AsyncReader::readFile(const std::string& filepath, BufferPool::Buffer& buffer) {
+#ifndef _WIN32
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    buffer.resize(st.st_size);
+    size_t done = 0;
+    while (done < buffer.size) {
+        ssize_t bytes = pread(fd, buffer.data.get() + done, buffer.size - done, done);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+        done += bytes;
+    }
+    close(fd);
+
+    buffer.size = done;
+    return done > 0;
+#else
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    size_t size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    buffer.resize(size);
+    file.read(reinterpret_cast<char*>(buffer.data.get()), size);
+    buffer.size = file.gcount();
+    return buffer.size > 0;
+#endif
+}
+
+void AsyncReader::threadLoop() {
+    Request request;
+    while (popRequest(request, true)) {
+        BufferPool::Buffer* buffer = pool.acquire();
+        if (!readFile(request.filepath, *buffer)) {
+            pool.release(buffer);
+            buffer = nullptr;
+        }
+        complete(std::move(request), buffer);
+    }
+}
+
+void AsyncReader::uringLoop() {
+#ifdef THUMBNAIL_HAVE_IO_URING
+    size_t in_flight = 0;
+
+    while (true) {
+        // Top up the ring while there are requests, slots and buffers
+        while (in_flight < static_cast<size_t>(queue_depth)) {
+            Request request;
+            if (!popRequest(request, in_flight == 0)) {
+                break;
+            }
+
+            // Block for a buffer only when nothing is in flight; otherwise
+            // reap completions first
+            BufferPool::Buffer* buffer = (in_flight == 0) ? pool.acquire() : pool.tryAcquire();
+            if (buffer == nullptr) {
+                pushFront(std::move(request));
+                break;
+            }
+
+            int fd = open(request.filepath.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                pool.release(buffer);
+                complete(std::move(request), nullptr);
+                continue;
+            }
+            buffer->resize(st.st_size);
+
+            size_t slot_index = ring->free_slots.back();
+            ring->free_slots.pop_back();
+            Ring::Slot& slot = ring->slots[slot_index];
+            slot.request = std::move(request);
+            slot.buffer = buffer;
+            slot.fd = fd;
+            slot.done = 0;
+            slot.used = true;
+            ring->queueRead(slot_index);
+            in_flight++;
+        }
+
+        if (in_flight == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping && pending.empty()) {
+                return;
+            }
+            continue;
+        }
+
+        int ret = ring->submitAndWait(1);
+        if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+            // Not transient: fail what is in flight and finish with plain reads
+            std::cerr << "io_uring_enter failed: " << std::strerror(-ret)
+                      << ", falling back to reader threads" << std::endl;
+            std::vector<Ring::Slot> failed;
+            for (auto& slot : ring->slots) {
+                if (slot.used) {
+                    failed.push_back(std::move(slot));
+                }
+            }
+            // Tear the ring down before its buffers go back to the pool
+            ring.reset();
+            for (auto& slot : failed) {
+                close(slot.fd);
+                pool.release(slot.buffer);
+                complete(std::move(slot.request), nullptr);
+            }
+            // As many blocking readers as the ring had slots; this thread is
+            // one of them and outlives the others
+            std::vector<std::thread> readers;
+            for (int i = 1; i < queue_depth; i++) {
+                readers.emplace_back(&AsyncReader::threadLoop, this);
+            }
+            threadLoop();
+            for (auto& reader : readers) {
+                reader.join();
+            }
+            return;
+        }
+
+        io_uring_cqe cqe;
+        while (ring->peek(cqe)) {
+            size_t slot_index = static_cast<size_t>(cqe.user_data);
+            Ring::Slot& slot = ring->slots[slot_index];
+
+            bool finished = true;
+            bool ok = false;
+            if (cqe.res > 0) {
+                slot.done += cqe.res;
+                if (slot.done < slot.buffer->size) {
+                    // Short read: queue the rest
+                    finished = !ring->queueRead(slot_index);
+                } else {
+                    ok = true;
+                }
+            } else if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                // Kernel without IORING_OP_READ: finish this file synchronously
+                close(slot.fd);
+                slot.fd = -1;
+                ok = readFile(slot.request.filepath, *slot.buffer);
+            } else if (cqe.res == 0) {
+                // File shrank while reading
+                slot.buffer->size = slot.done;
+                ok = slot.done > 0;
+            }
+
+            if (finished) {
+                if (slot.fd >= 0) {
+                    close(slot.fd);
+                }
+                BufferPool::Buffer* buffer = slot.buffer;
+                if (!ok) {
+                    pool.release(buffer);
+                    buffer = nullptr;
+                }
+                Request request = std::move(slot.request);
+                slot = Ring::Slot();
+                ring->free_slots.push_back(slot_index);
+                in_flight--;
+                complete(std::move(request), buffer);
+            }
+        }
+    }
+#endif
+}
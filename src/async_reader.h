@@ -0,0 +1,87 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "config.h"
+
+// Input stage that reads whole files into pooled buffers ahead of decoding.
+// The io_uring backend keeps up to queue_depth reads in flight from a single
+// thread; the thread backend (used where io_uring is unavailable) runs
+// queue_depth blocking readers. Filled buffers are handed to a completion
+// callback, which owns the buffer until it releases it to the pool.
+class AsyncReader {
+public:
+    struct Request {
+        std::string filepath;
+        uint64_t order;
+        int64_t file_size;
+    };
+
+    // buffer is nullptr if the file could not be read
+    using Completion = std::function<void(Request request, BufferPool::Buffer* buffer)>;
+
+    AsyncReader(ReaderBackend backend, int queue_depth, BufferPool& pool, Completion on_read);
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    // Queue a read. At most as many reads as the pool has buffers wait to
+    // start: submit blocks until there is room, trySubmit instead returns
+    // false and leaves request untouched. Worker tasks, which may be needed
+    // to release buffers, must use trySubmit.
+    void submit(Request request);
+    bool trySubmit(Request& request);
+
+    // Block until every queued read has been delivered to the callback
+    void drain();
+
+    // Parse a --reader name: "direct", "threads", "uring" or "mmap" (the
+    // direct and mmap modes read inside the workers, without an AsyncReader)
+    static bool parseBackend(const std::string& name, ReaderBackend& backend);
+    static const char* getBackendName(ReaderBackend backend);
+
+    // Backend actually in use (io_uring falls back to threads if the
+    // kernel or sandbox refuses it)
+    ReaderBackend getBackend() const;
+
+private:
+    bool popRequest(Request& request, bool block);
+    void pushFront(Request request);
+    void complete(Request request, BufferPool::Buffer* buffer);
+
+    void threadLoop();
+    void uringLoop();
+
+    // Blocking read of a whole file into a pool buffer
+    static bool readFile(const std::string& filepath, BufferPool::Buffer& buffer);
+
+    ReaderBackend backend;
+    int queue_depth;
+    BufferPool& pool;
+    Completion on_read;
+
+    std::mutex mutex;
+    std::condition_variable request_cv;
+    std::condition_variable drained_cv;
+    std::condition_variable space_cv;
+    std::deque<Request> pending;  // Bounded by the pool's buffer count
+    int64_t outstanding;  // Submitted but not yet delivered
+    bool stopping;
+
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+    std::vector<std::thread> threads;
+};
+
+#endif // ASYNC_READER_H
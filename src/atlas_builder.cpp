@@ -0,0 +1,237 @@
+#include "atlas_builder.h"
+#include "stb_image_write.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+const char* const AtlasBuilder::kMapFileName = "atlas.json";
+
+namespace {
+    std::string pageFileName(int index) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "atlas-%05d.jpg", index);
+        return name;
+    }
+
+    void writeJsonString(std::ostream& out, const std::string& value) {
+        out << '"';
+        for (unsigned char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+}
+
+AtlasBuilder::AtlasBuilder()
+    : atlas_size(4096), current(nullptr), shelf_x(0), shelf_y(0), shelf_height(0), write_failed(false) {}
+
+AtlasBuilder::~AtlasBuilder() = default;
+
+bool AtlasBuilder::open(const std::string& directory, int atlas_size) {
+    this->directory = directory;
+    this->atlas_size = atlas_size;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Failed to create " << directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current = newPage();
+    return true;
+}
+
+AtlasBuilder::Page* AtlasBuilder::newPage() {
+    size_t bytes = static_cast<size_t>(atlas_size) * atlas_size * 3;
+    std::unique_ptr<Page> page(new Page{static_cast<int>(pages.size()), atlas_size,
+                                        std::unique_ptr<unsigned char[]>(new unsigned char[bytes]), 0, false});
+    // White background between shelves and under short thumbnails
+    std::memset(page->pixels.get(), 0xff, bytes);
+    shelf_x = 0;
+    shelf_y = 0;
+    shelf_height = 0;
+    pages.push_back(std::move(page));
+    return pages.back().get();
+}
+
+AtlasBuilder::Page* AtlasBuilder::seal(Page* page, int used_height) {
+    page->sealed = true;
+    page->height = used_height;
+    return page->pending == 0 ? page : nullptr;
+}
+
+bool AtlasBuilder::add(const std::string& source_path, const ImageProcessor::ImageData& thumbnail) {
+    if (!thumbnail.is_valid || thumbnail.width > atlas_size || thumbnail.height > atlas_size) {
+        return false;
+    }
+
+    Page* page = nullptr;
+    Page* full_page = nullptr;
+    int x = 0;
+    int y = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current == nullptr) {
+            return false;
+        }
+
+        // Next shelf if the row is full, next page if the shelves are
+        if (shelf_x + thumbnail.width > atlas_size) {
+            shelf_y += shelf_height;
+            shelf_x = 0;
+            shelf_height = 0;
+        }
+        if (shelf_y + thumbnail.height > atlas_size) {
+            full_page = seal(current, shelf_y + shelf_height);
+            current = newPage();
+        }
+
+        page = current;
+        x = shelf_x;
+        y = shelf_y;
+        shelf_x += thumbnail.width;
+        shelf_height = std::max(shelf_height, thumbnail.height);
+        page->pending++;
+
+        placements.push_back(Placement{source_path, page->index, x, y, thumbnail.width, thumbnail.height});
+    }
+
+    if (full_page != nullptr) {
+        writePage(full_page);
+    }
+
+    blit(thumbnail, page->pixels.get(), atlas_size, x, y);
+
+    Page* ready = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        page->pending--;
+        if (page->sealed && page->pending == 0) {
+            ready = page;
+        }
+    }
+    if (ready != nullptr) {
+        writePage(ready);
+    }
+    return true;
+}
+
+void AtlasBuilder::blit(const ImageProcessor::ImageData& thumbnail, unsigned char* canvas,
+                        int canvas_width, int x, int y) {
+    // Atlases are RGB: gray is replicated, alpha dropped
+    int channels = thumbnail.channels;
+    for (int row = 0; row < thumbnail.height; row++) {
+        const unsigned char* src = thumbnail.data + static_cast<size_t>(row) * thumbnail.width * channels;
+        unsigned char* dst = canvas + (static_cast<size_t>(y + row) * canvas_width + x) * 3;
+        if (channels == 3) {
+            std::memcpy(dst, src, static_cast<size_t>(thumbnail.width) * 3);
+            continue;
+        }
+        for (int col = 0; col < thumbnail.width; col++) {
+            const unsigned char* p = src + col * channels;
+            if (channels >= 3) {
+                dst[0] = p[0];
+                dst[1] = p[1];
+                dst[2] = p[2];
+            } else {
+                dst[0] = dst[1] = dst[2] = p[0];
+            }
+            dst += 3;
+        }
+    }
+}
+
+void AtlasBuilder::writePage(Page* page) {
+    std::string path = (fs::path(directory) / pageFileName(page->index)).string();
+    if (!stbi_write_jpg(path.c_str(), atlas_size, page->height, 3, page->pixels.get(), 85)) {
+        std::cerr << "Failed to write atlas: " << path << std::endl;
+        write_failed.store(true, std::memory_order_relaxed);
+    }
+    page->pixels.reset();
+}
+
+void AtlasBuilder::addAlias(const std::string& source_path, const std::string& canonical_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    aliases.emplace_back(source_path, canonical_path);
+}
+
+bool AtlasBuilder::finish() {
+    Page* last = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current == nullptr) {
+            return false;
+        }
+        int used_height = shelf_y + shelf_height;
+        if (used_height == 0) {
+            // Nothing was placed since the previous page filled up
+            pages.pop_back();
+        } else {
+            last = seal(current, used_height);
+        }
+        current = nullptr;
+    }
+    // Every add() has returned by now, so the last page is complete
+    if (last != nullptr) {
+        writePage(last);
+    }
+    return writeMap() && !write_failed.load(std::memory_order_relaxed);
+}
+
+bool AtlasBuilder::writeMap() {
+    std::unordered_map<std::string, size_t> by_path;
+    for (size_t i = 0; i < placements.size(); i++) {
+        by_path.emplace(placements[i].source_path, i);
+    }
+    for (const auto& alias : aliases) {
+        auto it = by_path.find(alias.second);
+        if (it != by_path.end()) {
+            Placement placement = placements[it->second];
+            placement.source_path = alias.first;
+            placements.push_back(placement);
+        }
+    }
+    std::sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) {
+        return a.source_path < b.source_path;
+    });
+
+    fs::path map_path = fs::path(directory) / kMapFileName;
+    std::ofstream out(map_path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to write atlas map: " << map_path << std::endl;
+        return false;
+    }
+
+    out << "{\n  \"atlases\": [";
+    for (size_t i = 0; i < pages.size(); i++) {
+        out << (i == 0 ? "\n" : ",\n") << "    {\"file\": ";
+        writeJsonString(out, pageFileName(pages[i]->index));
+        out << ", \"width\": " << atlas_size << ", \"height\": " << pages[i]->height << "}";
+    }
+    out << "\n  ],\n  \"images\": {";
+    for (size_t i = 0; i < placements.size(); i++) {
+        const Placement& p = placements[i];
+        out << (i == 0 ? "\n" : ",\n") << "    ";
+        writeJsonString(out, p.source_path);
+        out << ": {\"atlas\": " << p.page << ", \"x\": " << p.x << ", \"y\": " << p.y
+            << ", \"w\": " << p.width << ", \"h\": " << p.height << "}";
+    }
+    out << "\n  }\n}\n";
+    return static_cast<bool>(out);
+}
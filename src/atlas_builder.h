@@ -0,0 +1,85 @@
+#ifndef ATLAS_BUILDER_H
+#define ATLAS_BUILDER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image_processor.h"
+
+// Packs thumbnails into sprite sheets for gallery pages. Thumbnails are
+// placed on shelves (rows as tall as their tallest thumbnail) of square
+// atlas_size pages; a page is written as "atlas-NNNNN.jpg" once it is full
+// and the last thumbnail copied into it has landed. atlas.json maps every
+// source path to its page and rectangle.
+//
+// Placement is serialized, but copying pixels and encoding full pages run
+// on the calling worker threads, so atlases fill while thumbnails are
+// still being generated.
+class AtlasBuilder {
+public:
+    static const char* const kMapFileName;  // "atlas.json"
+
+    AtlasBuilder();
+    ~AtlasBuilder();
+
+    AtlasBuilder(const AtlasBuilder&) = delete;
+    AtlasBuilder& operator=(const AtlasBuilder&) = delete;
+
+    bool open(const std::string& directory, int atlas_size);
+
+    // Place a thumbnail; safe to call from any thread
+    bool add(const std::string& source_path, const ImageProcessor::ImageData& thumbnail);
+
+    // Map source_path to the rectangle already placed for canonical_path
+    void addAlias(const std::string& source_path, const std::string& canonical_path);
+
+    // Write the last (cropped) page and the coordinate map
+    bool finish();
+
+private:
+    struct Page {
+        int index;
+        int height;  // Final height; the last page is cropped to its shelves
+        std::unique_ptr<unsigned char[]> pixels;  // RGB
+        int pending;  // Thumbnails placed but not yet copied in
+        bool sealed;  // No further placements
+    };
+
+    struct Placement {
+        std::string source_path;
+        int page;
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    Page* newPage();
+    // Called with the lock held; returns the page if it is ready to write
+    Page* seal(Page* page, int used_height);
+    void writePage(Page* page);
+    bool writeMap();
+
+    static void blit(const ImageProcessor::ImageData& thumbnail, unsigned char* canvas,
+                     int canvas_width, int x, int y);
+
+    std::string directory;
+    int atlas_size;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Page>> pages;
+    Page* current;
+    int shelf_x;
+    int shelf_y;
+    int shelf_height;
+
+    std::vector<Placement> placements;
+    std::vector<std::pair<std::string, std::string>> aliases;
+    std::atomic<bool> write_failed;
+};
+
+#endif // ATLAS_BUILDER_H
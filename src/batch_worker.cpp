@@ -0,0 +1,125 @@
+#include "batch_worker.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "socket_stream.h"
+#include "thumbnail_pipeline.h"
+
+namespace {
+    // The coordinator may still be collecting its input when workers start
+    const int kConnectAttempts = 120;
+    const int kConnectRetryMilliseconds = 500;
+
+    std::string formatHash(uint64_t phash) {
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(phash));
+        return hex;
+    }
+
+    // "<host>:<pid>", to tell workers apart in the coordinator's log
+    std::string workerName() {
+        char host[256] = "worker";
+        gethostname(host, sizeof(host) - 1);
+        return std::string(host) + ":" + std::to_string(getpid());
+    }
+}
+
+BatchWorker::BatchWorker(const Config& config, int num_threads)
+    : config(config),
+      scheduler(num_threads) {
+}
+
+bool BatchWorker::run(const std::string& address) {
+    int fd = -1;
+    for (int attempt = 0; attempt < kConnectAttempts && fd < 0; attempt++) {
+        if (attempt > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kConnectRetryMilliseconds));
+        }
+        fd = connectTcp(address, attempt + 1 < kConnectAttempts);
+    }
+    if (fd < 0) {
+        return false;
+    }
+
+    std::cout << "Worker connected to " << address << " with " << scheduler.getThreadCount()
+              << " threads\n" << std::flush;
+
+    SocketStream connection(fd);
+    const std::string lease_request = "LEASE " + workerName() + "\n";
+    uint64_t batch_count = 0;
+    uint64_t image_count = 0;
+    bool ok = false;
+    std::string line;
+    while (connection.write(lease_request) && connection.readLine(line)) {
+        std::istringstream reply(line);
+        std::string kind;
+        reply >> kind;
+        if (kind == "DONE") {
+            ok = true;
+            break;
+        }
+        if (kind == "WAIT") {
+            int milliseconds = 0;
+            reply >> milliseconds;
+            std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+            continue;
+        }
+
+        uint64_t lease = 0;
+        size_t count = 0;
+        if (kind != "BATCH" || !(reply >> lease >> count)) {
+            std::cerr << "Unexpected reply from coordinator: " << line << std::endl;
+            break;
+        }
+        std::vector<std::string> items(count);
+        std::vector<std::string> paths(count);
+        bool complete = true;
+        for (size_t i = 0; i < count && complete; i++) {
+            size_t tab;
+            complete = connection.readLine(line) && (tab = line.find('\t')) != std::string::npos;
+            if (complete) {
+                items[i] = line.substr(0, tab);
+                paths[i] = line.substr(tab + 1);
+            }
+        }
+        if (!complete) {
+            break;
+        }
+
+        ThumbnailPipeline pipeline(config, scheduler);
+        pipeline.submitAll(paths);
+        pipeline.wait();
+
+        std::string report = "RESULT " + std::to_string(lease) + " " + std::to_string(count) + "\n";
+        for (const auto& result : pipeline.collectResults()) {
+            report += result.success ? "OK\t" : "FAIL\t";
+            report += items[result.order];
+            report += '\t';
+            report += result.md5.empty() ? "-" : result.md5;
+            report += '\t';
+            report += result.success ? formatHash(result.phash) : "-";
+            report += '\n';
+        }
+        // A STALE reply still means the results were taken
+        if (!connection.write(report) || !connection.readLine(line) || (line != "OK" && line != "STALE")) {
+            break;
+        }
+        batch_count++;
+        image_count += count;
+    }
+    close(fd);
+
+    if (!ok) {
+        std::cerr << "Lost connection to coordinator " << address << std::endl;
+    }
+    std::cout << "Worker processed " << image_count << " images in " << batch_count << " batches\n";
+    return ok;
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_WORKER_H
+#define BATCH_WORKER_H
+
+#include <string>
+
+#include "config.h"
+#include "task_scheduler.h"
+
+// Worker of the distributed batch mode (--worker): leases batches from a
+// CoordinatorServer, thumbnails them into output_dir (normally a store
+// shared with the other workers) and reports each image's hashes back,
+// until the coordinator has no work left.
+class BatchWorker {
+public:
+    BatchWorker(const Config& config, int num_threads);
+
+    BatchWorker(const BatchWorker&) = delete;
+    BatchWorker& operator=(const BatchWorker&) = delete;
+
+    // Work for the coordinator at "host:port" until it is done; false if it
+    // could not be reached or the connection was lost
+    bool run(const std::string& address);
+
+private:
+    const Config config;
+    TaskScheduler scheduler;
+};
+
+#endif // BATCH_WORKER_H
@@ -0,0 +1,52 @@
+#include "buffer_pool.h"
+
+void BufferPool::Buffer::resize(size_t n) {
+    if (n > capacity) {
+        // Grow geometrically so slightly larger files don't reallocate again
+        size_t grown = capacity + capacity / 2;
+        capacity = n > grown ? n : grown;
+        data.reset(new unsigned char[capacity]);
+    }
+    size = n;
+}
+
+BufferPool::BufferPool(size_t max_buffers) {
+    if (max_buffers < 1) {
+        max_buffers = 1;
+    }
+    for (size_t i = 0; i < max_buffers; i++) {
+        buffers.emplace_back(new Buffer());
+        free_buffers.push_back(buffers.back().get());
+    }
+}
+
+BufferPool::Buffer* BufferPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this]() { return !free_buffers.empty(); });
+    Buffer* buffer = free_buffers.back();
+    free_buffers.pop_back();
+    return buffer;
+}
+
+BufferPool::Buffer* BufferPool::tryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_buffers.empty()) {
+        return nullptr;
+    }
+    Buffer* buffer = free_buffers.back();
+    free_buffers.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->size = 0;
+        free_buffers.push_back(buffer);
+    }
+    available.notify_one();
+}
+
+size_t BufferPool::getBufferCount() const {
+    return buffers.size();
+}
@@ -0,0 +1,46 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fixed number of reusable byte buffers for file contents. Buffers keep
+// their capacity between uses, so after warm-up reads need no allocation,
+// and the buffer count bounds how much input can be resident at once.
+class BufferPool {
+public:
+    struct Buffer {
+        std::unique_ptr<unsigned char[]> data;
+        size_t capacity = 0;
+        size_t size = 0;
+
+        // Make room for n bytes (contents are not preserved) and set size
+        void resize(size_t n);
+    };
+
+    explicit BufferPool(size_t max_buffers);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Take a buffer, blocking while all of them are in use
+    Buffer* acquire();
+
+    // Take a buffer, or nullptr if all of them are in use
+    Buffer* tryAcquire();
+
+    void release(Buffer* buffer);
+
+    size_t getBufferCount() const;
+
+private:
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<Buffer*> free_buffers;
+    std::mutex mutex;
+    std::condition_variable available;
+};
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,185 @@
+#include "checkpoint_journal.h"
+#include "hash_index.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char kMagic[8] = {'T', 'H', 'M', 'B', 'J', 'R', 'N', '1'};
+    const uint32_t kVersion = 1;
+
+    // Write out at least this often, or as soon as this many are queued
+    const auto kFlushInterval = std::chrono::seconds(1);
+    const size_t kFlushEntries = 16384;
+
+    bool readHeader(std::FILE* file, CheckpointJournal::Header& header) {
+        return std::fread(&header, sizeof(header), 1, file) == 1 &&
+               std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+    }
+}
+
+CheckpointJournal::CheckpointJournal()
+    : file(nullptr), stopping(false), failed(false) {
+}
+
+CheckpointJournal::~CheckpointJournal() {
+    close();
+}
+
+uint64_t CheckpointJournal::fingerprint(const std::vector<std::string>& image_files) {
+    // FNV-1a over the paths, each terminated by a NUL
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto& path : image_files) {
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        hash = hash * 1099511628211ull;
+    }
+    return hash ^ image_files.size();
+}
+
+bool CheckpointJournal::replay(const std::string& filepath, const std::vector<std::string>& image_files,
+                               std::vector<Entry>& entries) {
+    entries.clear();
+    std::FILE* in = std::fopen(filepath.c_str(), "rb");
+    if (in == nullptr) {
+        std::cerr << "Cannot open checkpoint journal: " << filepath << std::endl;
+        return false;
+    }
+
+    Header header;
+    if (!readHeader(in, header)) {
+        std::cerr << "Not a checkpoint journal: " << filepath << std::endl;
+        std::fclose(in);
+        return false;
+    }
+    if (header.fingerprint != fingerprint(image_files) || header.image_count != image_files.size()) {
+        std::cerr << "Checkpoint journal " << filepath << " was written for a different input list" << std::endl;
+        std::fclose(in);
+        return false;
+    }
+
+    Entry entry;
+    while (std::fread(&entry, sizeof(entry), 1, in) == 1) {
+        if (entry.index < image_files.size()) {
+            entries.push_back(entry);
+        }
+    }
+    std::fclose(in);
+    return true;
+}
+
+bool CheckpointJournal::open(const std::string& filepath, const std::vector<std::string>& image_files,
+                             bool append) {
+    close();
+
+    std::error_code ec;
+    if (append && fs::exists(filepath, ec)) {
+        // Drop a torn entry left by a crash so new ones stay aligned
+        uintmax_t size = fs::file_size(filepath, ec);
+        if (!ec && size >= sizeof(Header)) {
+            uintmax_t whole = sizeof(Header) + (size - sizeof(Header)) / sizeof(Entry) * sizeof(Entry);
+            if (whole != size) {
+                fs::resize_file(filepath, whole, ec);
+            }
+        }
+        file = std::fopen(filepath.c_str(), "ab");
+    } else {
+        file = std::fopen(filepath.c_str(), "wb");
+        if (file != nullptr) {
+            Header header;
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.reserved = 0;
+            header.fingerprint = fingerprint(image_files);
+            header.image_count = image_files.size();
+            if (std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fflush(file) != 0) {
+                std::fclose(file);
+                file = nullptr;
+            }
+        }
+    }
+    if (file == nullptr) {
+        std::cerr << "Cannot write checkpoint journal: " << filepath << std::endl;
+        return false;
+    }
+
+    stopping = false;
+    failed = false;
+    writer = std::thread(&CheckpointJournal::writerLoop, this);
+    return true;
+}
+
+void CheckpointJournal::add(uint64_t index, const std::string& md5, uint64_t phash) {
+    Entry entry;
+    entry.index = index;
+    entry.phash = phash;
+    HashIndex::packDigest(md5, entry.digest);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.push_back(entry);
+    if (queued.size() == kFlushEntries) {
+        queued_cv.notify_one();
+    }
+}
+
+bool CheckpointJournal::close() {
+    if (file == nullptr) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued_cv.notify_one();
+    writer.join();
+
+    bool ok = !failed && std::fclose(file) == 0;
+    file = nullptr;
+    return ok;
+}
+
+void CheckpointJournal::writerLoop() {
+    std::vector<Entry> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queued_cv.wait_for(lock, kFlushInterval, [this]() {
+            return stopping || queued.size() >= kFlushEntries;
+        });
+        bool last = stopping;
+        batch.swap(queued);
+        lock.unlock();
+
+        if (!batch.empty() && !failed && !writeBatch(batch)) {
+            std::cerr << "Failed to write checkpoint journal" << std::endl;
+            failed = true;
+        }
+        batch.clear();
+
+        lock.lock();
+        if (last && queued.empty()) {
+            break;
+        }
+    }
+}
+
+bool CheckpointJournal::writeBatch(const std::vector<Entry>& batch) {
+    if (std::fwrite(batch.data(), sizeof(Entry), batch.size(), file) != batch.size() ||
+        std::fflush(file) != 0) {
+        return false;
+    }
+    // Entries count as finished work only once they are on disk
+#ifdef __linux__
+    fdatasync(fileno(file));
+#elif !defined(_WIN32)
+    fsync(fileno(file));
+#endif
+    return true;
+}
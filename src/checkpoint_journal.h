@@ -0,0 +1,78 @@
+#ifndef CHECKPOINT_JOURNAL_H
+#define CHECKPOINT_JOURNAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only record of the images a batch run has finished (--checkpoint),
+// so an interrupted run can pick up where it stopped (--resume):
+//
+//   Header
+//   Entry[]  one per finished image, in completion order
+//
+// Workers only queue entries in memory; a background thread writes them
+// out in batches every second (or sooner when many are queued) and syncs
+// the file, so the cost on the processing path is a short locked append.
+// A crash loses at most the last unwritten batch. Entries refer to images
+// by their position in the input list, which the header fingerprints so a
+// journal is never replayed against a different list. Host byte order.
+class CheckpointJournal {
+public:
+    struct Header {
+        char magic[8];  // "THMBJRN1"
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t fingerprint;  // See fingerprint()
+        uint64_t image_count;
+    };
+
+    struct Entry {
+        uint64_t index;  // Position in the input list
+        uint64_t phash;
+        unsigned char digest[16];  // MD5, all zero if unknown
+    };
+
+    CheckpointJournal();
+    ~CheckpointJournal();
+
+    CheckpointJournal(const CheckpointJournal&) = delete;
+    CheckpointJournal& operator=(const CheckpointJournal&) = delete;
+
+    // Identifies an input list (its length and paths, in order)
+    static uint64_t fingerprint(const std::vector<std::string>& image_files);
+
+    // Read the entries of the journal at filepath, which must have been
+    // written for image_files; a torn entry at the end is ignored
+    static bool replay(const std::string& filepath, const std::vector<std::string>& image_files,
+                       std::vector<Entry>& entries);
+
+    // Start writing for image_files. With append, entries are added to
+    // the existing (replayed) journal; otherwise it is started afresh.
+    bool open(const std::string& filepath, const std::vector<std::string>& image_files, bool append);
+
+    // Queue a finished image; safe to call from any thread
+    void add(uint64_t index, const std::string& md5, uint64_t phash);
+
+    // Write out everything queued and stop the writer; false if any write failed
+    bool close();
+
+private:
+    void writerLoop();
+    bool writeBatch(const std::vector<Entry>& batch);
+
+    std::FILE* file;
+    std::thread writer;
+
+    std::mutex mutex;
+    std::condition_variable queued_cv;
+    std::vector<Entry> queued;
+    bool stopping;
+    bool failed;  // Only touched by the writer until it has stopped
+};
+
+#endif // CHECKPOINT_JOURNAL_H
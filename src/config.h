@@ -0,0 +1,76 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstddef>
+#include <string>
+
+// Order in which a collected work list is processed
+enum class InputOrder {
+    Scan,    // As found by the scanner / given in the list
+    Inode,   // By (device, inode): cheap proxy for on-disk placement
+    Extent,  // By physical offset of the first extent (FIEMAP)
+};
+
+// How the parallel mode reads input files
+enum class ReaderBackend {
+    Direct,   // Each worker opens and reads its own file (stbi_load / ifstream)
+    Threads,  // Dedicated reader threads fill pooled buffers
+    IoUring,  // One thread keeps queue_depth reads in flight via io_uring
+    Mmap,     // Each worker maps its file read-only and decodes from the mapping
+};
+
+// What to write for the thumbnail of an exact duplicate
+enum class DuplicateOutput {
+    None,      // Nothing; the duplicate is only recorded
+    Hardlink,  // Hard link to the original's thumbnail
+    Reflink,   // FICLONE copy sharing extents (plain copy if unsupported)
+    Symlink,   // Symbolic link to the original's thumbnail
+};
+
+// Where thumbnails are written inside output_dir
+enum class ThumbnailLayout {
+    Flat,     // <stem>_thumb.jpg
+    Sharded,  // ab/cd/<content digest>.jpg plus a source -> digest index
+    Archive,  // Packed segment files plus a sorted, mmap-able index
+    Atlas,    // Shelf-packed sprite sheets plus a JSON coordinate map
+};
+
+// Command line configuration shared by the processing modes
+struct Config {
+    std::string input_dir;
+    std::string file_list;  // Read paths from this list instead of scanning ("-" = stdin)
+    std::string output_dir;
+    int thumbnail_size = 256;
+    int hamming_threshold = 8;
+    int num_threads = 0;  // 0 = use all available
+    InputOrder input_order = InputOrder::Scan;
+    int prefetch_window = 32;  // Files hinted for readahead ahead of processing
+    ReaderBackend reader = ReaderBackend::Direct;
+    int queue_depth = 32;  // Reads in flight for the Threads/IoUring readers
+    bool skip_exact_duplicates = false;  // Hash first, skip decoding byte-identical files
+    DuplicateOutput duplicate_output = DuplicateOutput::None;  // Implies skip_exact_duplicates
+    ThumbnailLayout layout = ThumbnailLayout::Flat;  // Non-flat implies skip_exact_duplicates
+    int atlas_size = 4096;  // Width and maximum height of atlas pages
+    std::string daemon_socket;  // Serve requests on this Unix socket instead of processing input_dir
+    std::string http_address;  // "[host:]port" to serve GET /thumb on instead of processing input_dir
+    size_t cache_bytes = 256 * 1024 * 1024;  // Thumbnail cache of the HTTP server
+    bool watch = false;  // Keep thumbnails of input_dir current as files change
+    int watch_debounce_ms = 500;  // Quiet period before a batch of changes is processed
+    std::string hash_index;  // Duplicate index file to start from and merge this run into
+    std::string external_dups_dir;  // Find duplicates out of core, spilling to this directory
+    size_t external_memory_bytes = 1024 * 1024 * 1024;  // Sort memory of the out-of-core search
+    int shard_index = 0;  // Process only the images of this shard (--shard i/N)...
+    int shard_count = 0;  // ...out of this many; 0 = not sharded
+    std::string coordinator_address;  // "[host:]port" to hand out the input to workers on
+    std::string worker_address;  // "host:port" of the coordinator to take batches from
+    size_t batch_size = 64;  // Images per coordinator lease
+    int lease_seconds = 60;  // Lease time before a batch is handed to another worker
+    std::string checkpoint_path;  // Journal of finished images for resuming the run
+    bool resume = false;  // Skip the images already in the checkpoint journal
+    bool run_serial = true;
+    bool run_parallel = true;
+    bool compare_modes = true;
+    bool help_requested = false;  // -h/--help: usage printed, nothing to run
+};
+
+#endif // CONFIG_H
@@ -0,0 +1,42 @@
+#include "content_hash_set.h"
+#include <functional>
+
+ContentHashSet::ContentHashSet(size_t shard_count) {
+    if (shard_count < 1) {
+        shard_count = 1;
+    }
+    for (size_t i = 0; i < shard_count; i++) {
+        shards.emplace_back(new Shard());
+    }
+}
+
+ContentHashSet::Shard& ContentHashSet::shardFor(const std::string& digest) {
+    return *shards[std::hash<std::string>()(digest) % shards.size()];
+}
+
+bool ContentHashSet::insert(const std::string& digest, const std::string& filepath, std::string& existing) {
+    Shard& shard = shardFor(digest);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto inserted = shard.owners.emplace(digest, filepath);
+    if (!inserted.second) {
+        existing = inserted.first->second;
+        return false;
+    }
+    return true;
+}
+
+size_t ContentHashSet::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->owners.size();
+    }
+    return total;
+}
+
+void ContentHashSet::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->owners.clear();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CONTENT_HASH_SET_H
+#define CONTENT_HASH_SET_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Concurrent set of content digests, each mapped to the first file seen
+// with that digest. Split into independently locked shards so workers
+// hashing different files rarely contend.
+class ContentHashSet {
+public:
+    explicit ContentHashSet(size_t shard_count = 64);
+
+    ContentHashSet(const ContentHashSet&) = delete;
+    ContentHashSet& operator=(const ContentHashSet&) = delete;
+
+    // Record filepath as the owner of digest. Returns false if the digest
+    // was already present, with the owning file stored in existing.
+    bool insert(const std::string& digest, const std::string& filepath, std::string& existing);
+
+    size_t size() const;
+    void clear();
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, std::string> owners;
+    };
+
+    Shard& shardFor(const std::string& digest);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+};
+
+#endif // CONTENT_HASH_SET_H
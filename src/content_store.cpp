@@ -0,0 +1,108 @@
+#include "content_store.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+const char* const ContentStore::kIndexFileName = "index.tsv";
+
+namespace {
+    void appendDirectory(ArenaString& path, const std::string& output_dir) {
+        path.append(output_dir.data(), output_dir.size());
+        if (!output_dir.empty() && output_dir.back() != '/' && output_dir.back() != '\\') {
+            path.push_back('/');
+        }
+    }
+}
+
+bool ContentStore::parseLayout(const std::string& name, ThumbnailLayout& layout) {
+    if (name == "flat") {
+        layout = ThumbnailLayout::Flat;
+    } else if (name == "sharded") {
+        layout = ThumbnailLayout::Sharded;
+    } else if (name == "archive") {
+        layout = ThumbnailLayout::Archive;
+    } else if (name == "atlas") {
+        layout = ThumbnailLayout::Atlas;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+ArenaString ContentStore::buildPath(const std::string& output_dir, const std::string& digest) {
+    ArenaString path;
+    path.reserve(output_dir.size() + digest.size() + 12);
+    appendDirectory(path, output_dir);
+    path.append(digest, 0, 2);
+    path.push_back('/');
+    path.append(digest, 2, 2);
+    path.push_back('/');
+    path.append(digest.data(), digest.size());
+    path.append(".jpg");
+    return path;
+}
+
+bool ContentStore::createShardDirectories(const std::string& output_dir, const std::string& digest) {
+    ScratchArena::Scope scratch(ScratchArena::local());
+    ArenaString directory;
+    appendDirectory(directory, output_dir);
+    directory.append(digest, 0, 2);
+    directory.push_back('/');
+    directory.append(digest, 2, 2);
+
+    std::error_code ec;
+    fs::create_directories(fs::path(directory.c_str()), ec);
+    if (ec) {
+        std::cerr << "Failed to create " << directory.c_str() << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::writeIndex(const std::string& output_dir,
+                              const std::vector<std::pair<std::string, std::string>>& entries) {
+    fs::path index_path = fs::path(output_dir) / kIndexFileName;
+    fs::path temp_path = index_path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream index(temp_path, std::ios::binary | std::ios::trunc);
+        if (!index) {
+            std::cerr << "Failed to write index: " << temp_path << std::endl;
+            return false;
+        }
+        for (const auto& entry : entries) {
+            index << entry.first << '\t' << entry.second << '\n';
+        }
+        if (!index) {
+            std::cerr << "Failed to write index: " << temp_path << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, index_path, ec);
+    if (ec) {
+        std::cerr << "Failed to write index: " << index_path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::appendIndex(const std::string& output_dir,
+                               const std::vector<std::pair<std::string, std::string>>& entries) {
+    fs::path index_path = fs::path(output_dir) / kIndexFileName;
+    std::ofstream index(index_path, std::ios::binary | std::ios::app);
+    for (const auto& entry : entries) {
+        index << entry.first << '\t' << entry.second << '\n';
+    }
+    index.flush();
+    if (!index) {
+        std::cerr << "Failed to append to index: " << index_path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef CONTENT_STORE_H
+#define CONTENT_STORE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "scratch_arena.h"
+
+// Content-addressed thumbnail layout: each thumbnail is stored once under
+// its source's content digest with a two-level hex fan-out
+// ("<output_dir>/ab/cd/<digest>.jpg"), which keeps directories small and
+// deduplicates by construction. An index maps source paths to digests.
+class ContentStore {
+public:
+    static const char* const kIndexFileName;  // "index.tsv" in the output directory
+
+    // Parse "flat", "sharded", "archive" or "atlas"
+    static bool parseLayout(const std::string& name, ThumbnailLayout& layout);
+
+    // Build "<output_dir>/ab/cd/<digest>.jpg" in the calling thread's scratch arena
+    static ArenaString buildPath(const std::string& output_dir, const std::string& digest);
+
+    // Create the fan-out directories for digest if they do not exist yet
+    static bool createShardDirectories(const std::string& output_dir, const std::string& digest);
+
+    // Write "<source path>\t<digest>" lines to the index, replacing it atomically
+    static bool writeIndex(const std::string& output_dir,
+                           const std::vector<std::pair<std::string, std::string>>& entries);
+
+    // Append lines to the index; a later line for a path supersedes earlier ones
+    static bool appendIndex(const std::string& output_dir,
+                            const std::vector<std::pair<std::string, std::string>>& entries);
+};
+
+#endif // CONTENT_STORE_H
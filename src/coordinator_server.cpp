@@ -0,0 +1,341 @@
+#include "coordinator_server.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // How long a worker waits before asking again while everything is leased
+    const int kWaitMilliseconds = 500;
+    const int kProgressSeconds = 10;
+
+    bool parseNumber(const std::string& text, uint64_t& value, int base = 10) {
+        if (text.empty() || text[0] == '-') {
+            return false;
+        }
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text.c_str(), &end, base);
+        if (errno != 0 || *end != '\0') {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    std::vector<std::string> splitFields(const std::string& line, char separator) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        for (std::string field; std::getline(stream, field, separator);) {
+            fields.push_back(field);
+        }
+        return fields;
+    }
+}
+
+CoordinatorServer::CoordinatorServer(std::vector<std::string> image_files, size_t batch_size, int lease_seconds)
+    : image_files(std::move(image_files)),
+      batch_size(batch_size > 0 ? batch_size : 1),
+      lease_time(lease_seconds > 0 ? lease_seconds : 1),
+      states(this->image_files.size(), ItemState::Pending),
+      md5s(this->image_files.size()),
+      phashes(this->image_files.size(), 0),
+      succeeded(this->image_files.size(), false),
+      next_lease(1),
+      done_count(0),
+      listen_fd(-1) {
+    for (size_t i = 0; i < this->image_files.size(); i++) {
+        pending.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+CoordinatorServer::~CoordinatorServer() {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+}
+
+bool CoordinatorServer::run(const std::string& address) {
+    listen_fd = listenTcp(address);
+    if (listen_fd < 0) {
+        return false;
+    }
+
+    std::cout << "Coordinator listening on " << address << " with " << image_files.size()
+              << " images in batches of " << batch_size << "\n" << std::flush;
+
+    bool finished = false;
+    Clock::time_point finished_at;
+    Clock::time_point last_progress = Clock::now();
+    while (true) {
+        // Reap connections that have ended
+        for (size_t i = 0; i < connection_threads.size();) {
+            if (*connection_threads[i].done) {
+                connection_threads[i].thread.join();
+                connection_threads[i] = std::move(connection_threads.back());
+                connection_threads.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        Clock::time_point now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            expireLeases();
+            if (!finished && isFinished()) {
+                finished = true;
+                finished_at = now;
+            }
+            if (!finished && now - last_progress >= std::chrono::seconds(kProgressSeconds)) {
+                last_progress = now;
+                std::cout << "Finished " << done_count << " of " << image_files.size() << " images ("
+                          << leases.size() << " leases out)\n" << std::flush;
+            }
+        }
+        // Once done, give workers a lease period to hear so and hang up
+        if (finished && (connection_threads.empty() || now - finished_at > lease_time)) {
+            break;
+        }
+
+        pollfd listener{listen_fd, POLLIN, 0};
+        int ready = poll(&listener, 1, 200);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "Poll failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connection_fds.insert(fd);
+            stats.workers++;
+        }
+
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([this, fd, done]() {
+            serveConnection(fd);
+            *done = true;
+        });
+        connection_threads.push_back(ConnectionThread{std::move(thread), done});
+    }
+
+    {
+        // Workers still connected after the grace period are cut off
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int fd : connection_fds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto& connection : connection_threads) {
+        connection.thread.join();
+    }
+    connection_threads.clear();
+
+    close(listen_fd);
+    listen_fd = -1;
+    return true;
+}
+
+void CoordinatorServer::serveConnection(int fd) {
+    SocketStream connection(fd);
+    std::string line;
+    while (connection.readLine(line)) {
+        std::vector<std::string> args;
+        std::istringstream tokens(line);
+        for (std::string token; tokens >> token;) {
+            args.push_back(token);
+        }
+        if (args.empty()) continue;
+
+        bool keep_open;
+        uint64_t lease_id, count;
+        if (args[0] == "LEASE") {
+            keep_open = handleLease(connection, fd, args.size() > 1 ? args[1] : "-");
+        } else if (args[0] == "RESULT") {
+            if (args.size() != 3 || !parseNumber(args[1], lease_id) || !parseNumber(args[2], count)) {
+                // The lines that may follow cannot be told apart from requests
+                connection.write("ERR usage: RESULT <lease> <count>\n");
+                break;
+            }
+            keep_open = handleResult(connection, lease_id, count);
+        } else {
+            keep_open = connection.write("ERR unknown request " + args[0] + "\n");
+        }
+        if (!keep_open) break;
+    }
+
+    {
+        // Whatever the worker still held goes to someone else
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = leases.begin(); it != leases.end();) {
+            if (it->second.fd == fd) {
+                auto next = std::next(it);
+                reissue(it, "lost its worker");
+                it = next;
+            } else {
+                ++it;
+            }
+        }
+        connection_fds.erase(fd);
+    }
+    close(fd);
+}
+
+bool CoordinatorServer::handleLease(SocketStream& connection, int fd, const std::string& worker) {
+    std::ostringstream reply;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        expireLeases();
+
+        Lease lease;
+        while (lease.items.size() < batch_size && !pending.empty()) {
+            uint32_t item = pending.front();
+            pending.pop_front();
+            // Finished meanwhile by a late result of an expired lease
+            if (states[item] != ItemState::Pending) continue;
+            states[item] = ItemState::Leased;
+            lease.items.push_back(item);
+        }
+
+        if (lease.items.empty()) {
+            if (isFinished()) {
+                reply << "DONE\n";
+            } else {
+                reply << "WAIT " << kWaitMilliseconds << "\n";
+            }
+        } else {
+            uint64_t id = next_lease++;
+            reply << "BATCH " << id << " " << lease.items.size() << "\n";
+            for (uint32_t item : lease.items) {
+                reply << item << "\t" << image_files[item] << "\n";
+            }
+            lease.deadline = Clock::now() + lease_time;
+            lease.fd = fd;
+            lease.worker = worker;
+            leases.emplace(id, std::move(lease));
+            stats.leases++;
+        }
+    }
+    return connection.write(reply.str());
+}
+
+bool CoordinatorServer::handleResult(SocketStream& connection, uint64_t lease_id, uint64_t count) {
+    struct Reported {
+        uint32_t item;
+        bool success;
+        std::string md5;
+        uint64_t phash;
+    };
+
+    std::vector<Reported> reported;
+    std::string line;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!connection.readLine(line)) {
+            return false;
+        }
+        std::vector<std::string> fields = splitFields(line, '\t');
+        uint64_t item, phash = 0;
+        if (fields.size() != 4 || (fields[0] != "OK" && fields[0] != "FAIL") ||
+            !parseNumber(fields[1], item) || item >= image_files.size() ||
+            (fields[3] != "-" && !parseNumber(fields[3], phash, 16))) {
+            connection.write("ERR malformed result: " + line + "\n");
+            return false;
+        }
+        reported.push_back(Reported{static_cast<uint32_t>(item), fields[0] == "OK",
+                                    fields[2] == "-" ? std::string() : fields[2], phash});
+    }
+
+    bool stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& result : reported) {
+            if (states[result.item] == ItemState::Done) continue;
+            states[result.item] = ItemState::Done;
+            md5s[result.item] = result.md5;
+            phashes[result.item] = result.phash;
+            succeeded[result.item] = result.success;
+            done_count++;
+        }
+
+        auto lease = leases.find(lease_id);
+        stale = lease == leases.end();
+        if (stale) {
+            stats.stale_results++;
+        } else {
+            // Images the worker did not report are handed out again
+            reissue(lease, nullptr);
+        }
+    }
+    return connection.write(stale ? "STALE\n" : "OK\n");
+}
+
+void CoordinatorServer::reissue(std::map<uint64_t, Lease>::iterator lease, const char* reason) {
+    size_t count = 0;
+    for (auto item = lease->second.items.rbegin(); item != lease->second.items.rend(); ++item) {
+        if (states[*item] == ItemState::Leased) {
+            states[*item] = ItemState::Pending;
+            pending.push_front(*item);
+            count++;
+        }
+    }
+    if (reason != nullptr) {
+        stats.reissued++;
+        std::cerr << "Lease " << lease->first << " of " << lease->second.worker << " " << reason
+                  << "; re-issuing " << count << " images" << std::endl;
+    }
+    leases.erase(lease);
+}
+
+void CoordinatorServer::expireLeases() {
+    Clock::time_point now = Clock::now();
+    for (auto it = leases.begin(); it != leases.end();) {
+        auto next = std::next(it);
+        if (it->second.deadline < now) {
+            reissue(it, "expired");
+        }
+        it = next;
+    }
+}
+
+bool CoordinatorServer::isFinished() const {
+    return done_count == image_files.size();
+}
+
+std::vector<ThumbnailPipeline::ImageResult> CoordinatorServer::collectResults() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ThumbnailPipeline::ImageResult> results;
+    results.reserve(image_files.size());
+    for (size_t i = 0; i < image_files.size(); i++) {
+        ThumbnailPipeline::ImageResult result;
+        result.filepath = image_files[i];
+        result.md5 = md5s[i];
+        result.phash = phashes[i];
+        result.order = i;
+        result.file_size = -1;
+        result.success = states[i] == ItemState::Done && succeeded[i];
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+CoordinatorServer::Stats CoordinatorServer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,105 @@
+#ifndef COORDINATOR_SERVER_H
+#define COORDINATOR_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "socket_stream.h"
+#include "thumbnail_pipeline.h"
+
+// Coordinator of the distributed batch mode (--coordinator): hands the
+// input list out to BatchWorker processes over TCP in batches and collects
+// their hashes, so faster nodes simply take more batches. Each batch is
+// leased; a lease that is not completed in time, or whose worker
+// disconnects, goes back to the front of the queue for another worker.
+//
+// Requests are one text line, replies likewise:
+//   LEASE <worker>\n   "BATCH <lease> <count>\n" then "<item>\t<path>\n" per
+//                      image; "WAIT <ms>\n" while all remaining images are
+//                      leased; "DONE\n" once every image is finished
+//   RESULT <lease> <count>\n then "OK|FAIL\t<item>\t<md5>\t<phash>\n" per
+//                      image ("-" for unknown hashes); "OK\n", or "STALE\n"
+//                      if the lease had expired - results for images not
+//                      finished yet are kept either way
+// Results are kept per image, so an image processed twice counts once.
+class CoordinatorServer {
+public:
+    struct Stats {
+        uint64_t leases = 0;
+        uint64_t reissued = 0;  // Leases that expired or lost their worker
+        uint64_t stale_results = 0;
+        uint64_t workers = 0;   // Connections served
+    };
+
+    CoordinatorServer(std::vector<std::string> image_files, size_t batch_size, int lease_seconds);
+    ~CoordinatorServer();
+
+    CoordinatorServer(const CoordinatorServer&) = delete;
+    CoordinatorServer& operator=(const CoordinatorServer&) = delete;
+
+    // Serve on "[host:]port" until every image is finished and the workers
+    // have been told so; false if the socket could not be set up
+    bool run(const std::string& address);
+
+    // Results in input order (failed for images never finished)
+    std::vector<ThumbnailPipeline::ImageResult> collectResults() const;
+
+    Stats getStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class ItemState : uint8_t { Pending, Leased, Done };
+
+    struct Lease {
+        std::vector<uint32_t> items;
+        Clock::time_point deadline;
+        int fd;  // Connection of the worker holding it
+        std::string worker;
+    };
+
+    struct ConnectionThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void serveConnection(int fd);
+    bool handleLease(SocketStream& connection, int fd, const std::string& worker);
+    bool handleResult(SocketStream& connection, uint64_t lease_id, uint64_t count);
+
+    // Put the unfinished images of a lease back in front of the queue;
+    // holds mutex
+    void reissue(std::map<uint64_t, Lease>::iterator lease, const char* reason);
+    void expireLeases();
+    bool isFinished() const;
+
+    const std::vector<std::string> image_files;
+    const size_t batch_size;
+    const std::chrono::seconds lease_time;
+
+    mutable std::mutex mutex;
+    std::vector<ItemState> states;
+    std::vector<std::string> md5s;
+    std::vector<uint64_t> phashes;
+    std::vector<bool> succeeded;
+    std::deque<uint32_t> pending;
+    std::map<uint64_t, Lease> leases;
+    uint64_t next_lease;
+    size_t done_count;
+    Stats stats;
+
+    int listen_fd;
+    std::set<int> connection_fds;  // Guarded by mutex
+    std::vector<ConnectionThread> connection_threads;  // Only touched by run()
+};
+
+#endif // COORDINATOR_SERVER_H
@@ -0,0 +1,326 @@
+#include "daemon_server.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "content_store.h"
+#include "socket_stream.h"
+#include "thumbnail_pipeline.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Largest in-memory image accepted
+    const size_t kMaxImageLength = 256 * 1024 * 1024;
+
+    bool parseNumber(const std::string& text, uint64_t& value) {
+        if (text.empty() || text[0] == '-') {
+            return false;
+        }
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+        if (errno != 0 || *end != '\0') {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    std::string formatHash(uint64_t phash) {
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(phash));
+        return hex;
+    }
+}
+
+DaemonServer::DaemonServer(const Config& config, int num_threads)
+    : config(config),
+      scheduler(num_threads),
+      service(scheduler),
+      index(config.hamming_threshold),
+      content_index_written(false),
+      request_count(0),
+      image_count(0),
+      stopping(false),
+      listen_fd(-1) {
+}
+
+DaemonServer::~DaemonServer() {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+}
+
+bool DaemonServer::run(const std::string& socket_path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socket_path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // A socket left behind by a daemon that did not shut down cleanly
+    std::error_code ec;
+    if (fs::is_socket(socket_path, ec)) {
+        fs::remove(socket_path, ec);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, 64) != 0) {
+        std::cerr << "Cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::cout << "Daemon listening on " << socket_path << " with "
+              << scheduler.getThreadCount() << " threads\n" << std::flush;
+
+    while (!stopping) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (!stopping) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << std::endl;
+            }
+            break;
+        }
+
+        // Reap connections that have ended
+        for (size_t i = 0; i < connection_threads.size();) {
+            if (*connection_threads[i].done) {
+                connection_threads[i].thread.join();
+                connection_threads[i] = std::move(connection_threads.back());
+                connection_threads.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            connection_fds.insert(fd);
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([this, fd, done]() {
+            serveConnection(fd);
+            *done = true;
+        });
+        connection_threads.push_back(ConnectionThread{std::move(thread), done});
+    }
+
+    stop();
+    for (auto& connection : connection_threads) {
+        connection.thread.join();
+    }
+    connection_threads.clear();
+
+    if (content_index_written) {
+        // Drop the lines superseded by later ones
+        std::vector<std::pair<std::string, std::string>> entries(content_index.begin(), content_index.end());
+        ContentStore::writeIndex(config.output_dir, entries);
+    }
+
+    close(listen_fd);
+    listen_fd = -1;
+    fs::remove(socket_path, ec);
+    std::cout << "Daemon stopped after " << request_count << " requests\n";
+    return true;
+}
+
+void DaemonServer::stop() {
+    stopping = true;
+    // Wakes accept() and every connection blocked reading its next request
+    shutdown(listen_fd, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    for (int fd : connection_fds) {
+        shutdown(fd, SHUT_RD);
+    }
+}
+
+void DaemonServer::serveConnection(int fd) {
+    SocketStream connection(fd);
+    std::string line;
+    while (!stopping && connection.readLine(line)) {
+        std::vector<std::string> args;
+        std::istringstream tokens(line);
+        for (std::string token; tokens >> token;) {
+            args.push_back(token);
+        }
+        if (args.empty()) continue;
+
+        request_count++;
+        bool keep_open;
+        if (args[0] == "FILES") {
+            keep_open = handleFiles(connection, args);
+        } else if (args[0] == "IMAGE") {
+            keep_open = handleImage(connection, args);
+        } else if (args[0] == "STATS") {
+            keep_open = handleStats(connection);
+        } else if (args[0] == "SHUTDOWN") {
+            connection.write("OK\n");
+            stop();
+            keep_open = false;
+        } else {
+            keep_open = connection.write("ERR unknown request " + args[0] + "\n");
+        }
+        if (!keep_open) break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connection_fds.erase(fd);
+    }
+    close(fd);
+}
+
+bool DaemonServer::parseSize(const std::vector<std::string>& args, size_t index, int& size) const {
+    size = config.thumbnail_size;
+    if (args.size() <= index) {
+        return true;
+    }
+    uint64_t value;
+    if (!parseNumber(args[index], value) || value == 0 || value > 65535) {
+        return false;
+    }
+    size = static_cast<int>(value);
+    return true;
+}
+
+bool DaemonServer::handleFiles(SocketStream& connection, const std::vector<std::string>& args) {
+    uint64_t count;
+    int size;
+    if (args.size() < 2 || !parseNumber(args[1], count) || !parseSize(args, 2, size)) {
+        // The paths that may follow cannot be told apart from requests
+        connection.write("ERR usage: FILES <count> [size]\n");
+        return false;
+    }
+
+    Config job = config;
+    job.thumbnail_size = size;
+    ThumbnailPipeline pipeline(job, scheduler);
+
+    // Workers start on the first paths while the rest are still arriving
+    std::string path;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!connection.readLine(path)) {
+            pipeline.wait();
+            return false;
+        }
+        pipeline.submit(path, i);
+    }
+    pipeline.wait();
+
+    std::vector<ThumbnailPipeline::ImageResult> results = pipeline.collectResults();
+    image_count += results.size();
+
+    std::string reply;
+    for (const auto& result : results) {
+        reply += result.success ? "OK\t" : "FAIL\t";
+        reply += result.md5.empty() ? "-" : result.md5;
+        reply += '\t';
+        reply += result.success ? formatHash(result.phash) : "-";
+        reply += '\t';
+        reply += result.filepath;
+        reply += '\n';
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        std::vector<DuplicateDetector::Match> matches;
+        std::vector<std::pair<std::string, std::string>> changed;
+        for (const auto& result : results) {
+            if (!result.success) continue;
+            index.insert(result.filepath, result.md5, result.phash, &matches);
+            for (const auto& match : matches) {
+                reply += "DUP\t" + result.filepath + "\t" + index.getFilepath(match.id) + "\n";
+            }
+            if (config.layout == ThumbnailLayout::Sharded) {
+                std::string& digest = content_index[result.filepath];
+                if (digest != result.md5) {
+                    digest = result.md5;
+                    changed.emplace_back(result.filepath, result.md5);
+                }
+            }
+        }
+        // Only the new rows are written, so a request costs the same however
+        // many images the daemon has seen; the first one starts a fresh index
+        if (!changed.empty() && content_index_written) {
+            ContentStore::appendIndex(config.output_dir, changed);
+        } else if (!changed.empty()) {
+            std::vector<std::pair<std::string, std::string>> entries(content_index.begin(), content_index.end());
+            content_index_written = ContentStore::writeIndex(config.output_dir, entries);
+        }
+    }
+
+    reply += "END\n";
+    return connection.write(reply);
+}
+
+bool DaemonServer::handleImage(SocketStream& connection, const std::vector<std::string>& args) {
+    uint64_t length;
+    int size;
+    if (args.size() < 2 || !parseNumber(args[1], length) || length > kMaxImageLength ||
+        !parseSize(args, 2, size)) {
+        connection.write("ERR usage: IMAGE <length> [size]\n");
+        return false;
+    }
+
+    std::vector<unsigned char> encoded;
+    if (!connection.readBytes(encoded, static_cast<size_t>(length))) {
+        return false;
+    }
+
+    ThumbnailService::Input input{encoded.data(), encoded.size()};
+    std::vector<ThumbnailService::ItemResult> results = service.submit({input}, size).get();
+    image_count++;
+
+    const ThumbnailService::ItemResult& result = results[0];
+    if (result.status != Thumbnailer::Status::Ok) {
+        return connection.write(std::string("ERR ") + Thumbnailer::getStatusMessage(result.status) + "\n");
+    }
+
+    // In-memory images have no path, so they are matched but not indexed
+    std::vector<std::string> matches;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        matches = index.findMatches(std::string(), result.content_hash, result.perceptual_hash);
+    }
+
+    std::ostringstream header;
+    header << "OK " << result.jpeg.size() << " " << result.width << " " << result.height << " "
+           << formatHash(result.perceptual_hash) << " " << result.content_hash << " " << matches.size() << "\n";
+    std::string trailer;
+    for (const auto& match : matches) {
+        trailer += "DUP\t" + match + "\n";
+    }
+    return connection.write(header.str()) && connection.write(result.jpeg.data(), result.jpeg.size()) &&
+           connection.write(trailer);
+}
+
+bool DaemonServer::handleStats(SocketStream& connection) {
+    size_t indexed;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        indexed = index.size();
+    }
+
+    std::ostringstream reply;
+    reply << "OK requests=" << request_count << " images=" << image_count
+          << " indexed=" << indexed << " threads=" << scheduler.getThreadCount()
+          << " pending=" << service.getPendingCount() << "\n";
+    return connection.write(reply.str());
+}
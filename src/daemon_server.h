@@ -0,0 +1,83 @@
+#ifndef DAEMON_SERVER_H
+#define DAEMON_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "duplicate_detector.h"
+#include "socket_stream.h"
+#include "task_scheduler.h"
+#include "thumbnail_service.h"
+
+// Long-running mode (--daemon): serves thumbnail jobs over a Unix domain
+// socket so the worker pool, per-thread scratch arenas and the duplicate
+// index stay warm between requests instead of being rebuilt by every
+// invocation. One thread per connection; all requests share the workers.
+//
+// Requests are one text line, optionally followed by a payload:
+//   FILES <count> [size]\n<path>\n...  thumbnails to output_dir as configured;
+//       replies "OK|FAIL\t<md5>\t<phash>\t<path>" per image, then
+//       "DUP\t<path>\t<earlier match>" against every image seen so far
+//   IMAGE <length> [size]\n<bytes>     thumbnail of an in-memory image;
+//       replies "OK <jpeg length> <width> <height> <phash> <md5> <matches>\n<jpeg>"
+//       followed by "DUP\t<path>\n" for each indexed image it duplicates
+//   STATS\n                            request and index counters
+//   SHUTDOWN\n                         stop after the running requests
+// Multi-line replies end with "END"; errors are a single "ERR <message>".
+// With the sharded layout, each FILES request appends the new or changed
+// images to index.tsv, which is rewritten with one line per path on SHUTDOWN.
+class DaemonServer {
+public:
+    DaemonServer(const Config& config, int num_threads);
+    ~DaemonServer();
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+    // Serve on socket_path until a SHUTDOWN request; false if the socket
+    // could not be set up
+    bool run(const std::string& socket_path);
+
+private:
+    struct ConnectionThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void serveConnection(int fd);
+    bool handleFiles(SocketStream& connection, const std::vector<std::string>& args);
+    bool handleImage(SocketStream& connection, const std::vector<std::string>& args);
+    bool handleStats(SocketStream& connection);
+    void stop();
+
+    bool parseSize(const std::vector<std::string>& args, size_t index, int& size) const;
+
+    const Config config;
+    TaskScheduler scheduler;
+    ThumbnailService service;
+
+    // Every image processed so far, for matching new ones against
+    std::mutex index_mutex;
+    DuplicateDetector index;
+    std::map<std::string, std::string> content_index;  // Path -> digest for the sharded layout
+    bool content_index_written;  // index.tsv holds content_index up to the last request
+
+    std::atomic<uint64_t> request_count;
+    std::atomic<uint64_t> image_count;
+
+    std::atomic<bool> stopping;
+    int listen_fd;
+    std::mutex connections_mutex;
+    std::set<int> connection_fds;
+    std::vector<ConnectionThread> connection_threads;  // Only touched by run()
+};
+
+#endif // DAEMON_SERVER_H
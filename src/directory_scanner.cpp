@@ -0,0 +1,148 @@
+#include "directory_scanner.h"
+#include "image_processor.h"
+#include "scratch_arena.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#endif
+
+namespace {
+#ifdef __linux__
+    // Record layout returned by getdents64 (not exported by glibc headers)
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    const size_t kDirentBufferSize = 64 * 1024;
+#endif
+
+    std::string joinPath(const std::string& directory, const char* name) {
+        std::string path;
+        path.reserve(directory.size() + std::strlen(name) + 1);
+        path.append(directory);
+        if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+            path.push_back('/');
+        }
+        path.append(name);
+        return path;
+    }
+}
+
+void DirectoryScanner::scan(TaskScheduler& scheduler, const std::string& root,
+                            FileCallback on_file, TaskGroup& group) {
+    auto callback = std::make_shared<const FileCallback>(std::move(on_file));
+    scheduler.submit([&scheduler, root, callback, &group]() {
+        scanDirectory(scheduler, root, callback, group);
+    }, TaskScheduler::Priority::Normal, &group);
+}
+
+#ifdef __linux__
+
+void DirectoryScanner::scanDirectory(TaskScheduler& scheduler, const std::string& directory,
+                                     const std::shared_ptr<const FileCallback>& on_file,
+                                     TaskGroup& group) {
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error scanning directory: " << directory << " - " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    ScratchArena::Scope scratch(ScratchArena::local());
+    char* buffer = static_cast<char*>(ScratchArena::local().allocate(kDirentBufferSize, 8));
+
+    while (true) {
+        long bytes = syscall(SYS_getdents64, fd, buffer, kDirentBufferSize);
+        if (bytes < 0) {
+            std::cerr << "Error reading directory: " << directory << " - " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (bytes == 0) {
+            break;
+        }
+
+        for (long pos = 0; pos < bytes;) {
+            auto* entry = reinterpret_cast<LinuxDirent64*>(buffer + pos);
+            pos += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // Filesystem without d_type, or a symlink: fall back to a stat.
+                // Like recursive_directory_iterator, links to directories are
+                // not followed but links to files are.
+                struct stat st;
+                int flags = (type == DT_UNKNOWN) ? AT_SYMLINK_NOFOLLOW : 0;
+                if (fstatat(fd, name, &st, flags) != 0) {
+                    continue;
+                }
+                if (S_ISREG(st.st_mode)) {
+                    type = DT_REG;
+                } else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) {
+                    type = DT_DIR;
+                } else {
+                    continue;
+                }
+            }
+
+            if (type == DT_DIR) {
+                std::string subdirectory = joinPath(directory, name);
+                scheduler.submit([&scheduler, subdirectory, on_file, &group]() {
+                    scanDirectory(scheduler, subdirectory, on_file, group);
+                }, TaskScheduler::Priority::Normal, &group);
+            } else if (type == DT_REG) {
+                std::string filepath = joinPath(directory, name);
+                if (ImageProcessor::isImageFile(filepath)) {
+                    (*on_file)(std::move(filepath));
+                }
+            }
+        }
+    }
+
+    close(fd);
+}
+
+#else
+
+void DirectoryScanner::scanDirectory(TaskScheduler& scheduler, const std::string& directory,
+                                     const std::shared_ptr<const FileCallback>& on_file,
+                                     TaskGroup& group) {
+    namespace fs = std::filesystem;
+
+    try {
+        for (const auto& entry : fs::directory_iterator(directory)) {
+            if (entry.is_directory() && !entry.is_symlink()) {
+                std::string subdirectory = entry.path().string();
+                scheduler.submit([&scheduler, subdirectory, on_file, &group]() {
+                    scanDirectory(scheduler, subdirectory, on_file, group);
+                }, TaskScheduler::Priority::Normal, &group);
+            } else if (entry.is_regular_file()) {
+                std::string filepath = entry.path().string();
+                if (ImageProcessor::isImageFile(filepath)) {
+                    (*on_file)(std::move(filepath));
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+    }
+}
+
+#endif
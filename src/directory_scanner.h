@@ -0,0 +1,30 @@
+#ifndef DIRECTORY_SCANNER_H
+#define DIRECTORY_SCANNER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "task_scheduler.h"
+
+// Parallel recursive directory walk. Every directory is scanned by its own
+// task on the scheduler; on Linux entries are read in large batches with
+// getdents64 and classified by d_type, so regular files cost no stat call.
+class DirectoryScanner {
+public:
+    // Called from worker threads, concurrently, once per image file found
+    using FileCallback = std::function<void(std::string filepath)>;
+
+    // Start scanning root. Directory tasks join the given group, so waiting
+    // on it also waits for everything the callback submitted to the group
+    // while the scan was running.
+    static void scan(TaskScheduler& scheduler, const std::string& root,
+                     FileCallback on_file, TaskGroup& group);
+
+private:
+    static void scanDirectory(TaskScheduler& scheduler, const std::string& directory,
+                              const std::shared_ptr<const FileCallback>& on_file,
+                              TaskGroup& group);
+};
+
+#endif // DIRECTORY_SCANNER_H
@@ -1,85 +1,342 @@
 #include "duplicate_detector.h"
-#include "hash_calculator.h"
 #include <iostream>
 #include <algorithm>
-#include <set>
+#include <bitset>
+#include <cstring>
+
+const int DuplicateDetector::kBlockCount;
+
+namespace {
+    int bitDistance(uint64_t a, uint64_t b) {
+        return static_cast<int>(std::bitset<64>(a ^ b).count());
+    }
+}
 
 DuplicateDetector::DuplicateDetector(int hamming_threshold) 
-    : hamming_threshold(hamming_threshold) {
+    : hamming_threshold(hamming_threshold), base_count(0), alive_count(0) {
 }
 
-void DuplicateDetector::addImageHash(const std::string& filepath, const std::string& md5, uint64_t phash) {
-    ImageHash img_hash;
-    img_hash.filepath = filepath;
-    img_hash.md5_hash = md5;
-    img_hash.perceptual_hash = phash;
-    
-    image_hashes.push_back(img_hash);
+bool DuplicateDetector::open(const std::string& filepath) {
+    clear();
+    if (!base.open(filepath)) {
+        return false;
+    }
+    base_count = static_cast<ImageId>(base.size());
+    alive_count = base_count;
+    return true;
 }
 
-std::vector<DuplicateDetector::DuplicateGroup> DuplicateDetector::findDuplicates() {
-    duplicate_groups.clear();
-    std::set<size_t> processed_indices;
+bool DuplicateDetector::save(const std::string& filepath) const {
+    // Paths of base images point into the mapping, which stays valid even
+    // when the file is replaced underneath it
+    std::vector<HashIndex::Record> records;
+    records.reserve(alive_count);
+    for (ImageId id = 0; id < base_count + entries.size(); id++) {
+        if (!isAlive(id)) continue;
+        HashIndex::Record record;
+        if (id < base_count) {
+            record.phash = base.getPhash(id);
+            std::memcpy(record.digest, base.getDigest(id), sizeof(record.digest));
+            record.path = base.getPath(id);
+        } else {
+            const Entry& entry = entries[id - base_count];
+            record.phash = entry.phash;
+            HashIndex::packDigest(entry.md5, record.digest);
+            record.path = entry.filepath;
+        }
+        record.group = findRoot(id);
+        records.push_back(record);
+    }
+    return HashIndex::write(filepath, records);
+}
+
+template <typename Visitor>
+void DuplicateDetector::probe(uint32_t key, int bits, int radius, int first_bit, Visitor& visit) {
+    visit(key);
+    if (radius == 0) return;
+    for (int bit = first_bit; bit < bits; bit++) {
+        probe(key ^ (1u << bit), bits, radius - 1, bit + 1, visit);
+    }
+}
+
+size_t DuplicateDetector::probeCount(int block_radius) {
+    // Keys within block_radius bits of a key, summed over the blocks
+    size_t count = 0;
+    for (int block = 0; block < kBlockCount; block++) {
+        int bits = HashIndex::blockBits(block);
+        size_t keys = 1;
+        size_t choose = 1;
+        for (int k = 1; k <= std::min(block_radius, bits); k++) {
+            choose = choose * (bits - k + 1) / k;
+            keys += choose;
+        }
+        count += keys;
+    }
+    return count;
+}
+
+void DuplicateDetector::collectWithin(uint64_t phash, int distance, int block_radius,
+                                      std::vector<Match>& matches) const {
+    auto consider = [&](ImageId id, uint64_t other) {
+        int other_distance = bitDistance(other, phash);
+        if (other_distance <= distance) {
+            matches.push_back(Match{id, other_distance});
+        }
+    };
     
-    // First pass: Find exact duplicates using MD5
-    std::map<std::string, std::vector<std::string>> md5_groups;
-    for (const auto& img : image_hashes) {
-        if (!img.md5_hash.empty()) {
-            md5_groups[img.md5_hash].push_back(img.filepath);
+    if (probeCount(block_radius) >= alive_count) {
+        // Small index (or large radius): a plain scan is cheaper
+        for (ImageId id = 0; id < base_count + entries.size(); id++) {
+            if (isAlive(id)) {
+                consider(id, getPhash(id));
+            }
         }
+        return;
+    }
+    
+    for (int block = 0; block < kBlockCount; block++) {
+        const auto& block_buckets = buckets[block];
+        auto visit = [&](uint32_t key) {
+            auto base_bucket = base.getBucket(block, key);
+            for (const uint64_t* it = base_bucket.first; it != base_bucket.second; ++it) {
+                // Equal hashes are adjacent; each is looked up once
+                if ((it != base_bucket.first && *it == it[-1]) || bitDistance(*it, phash) > distance) {
+                    continue;
+                }
+                auto ids = base.findPhash(*it);
+                for (ImageId id = ids.first; id < ids.second; id++) {
+                    if (!base_removed.count(id)) {
+                        consider(id, *it);
+                    }
+                }
+            }
+            if (block_buckets.empty()) return;
+            // Hashes are kept in the bucket so misses never touch entries
+            for (const Slot& slot : block_buckets[key]) {
+                consider(slot.id, slot.phash);
+            }
+        };
+        int bits = HashIndex::blockBits(block);
+        probe(HashIndex::blockOf(phash, block), bits, std::min(block_radius, bits), 0, visit);
+    }
+}
+
+DuplicateDetector::ImageId DuplicateDetector::insert(const std::string& filepath, const std::string& md5,
+                                                     uint64_t phash, std::vector<Match>* matches) {
+    ImageId existing;
+    if (findId(filepath, existing)) {
+        remove(existing);
+    }
+    
+    std::vector<Match> found = query(md5, phash);
+    
+    ImageId id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+    } else {
+        id = base_count + static_cast<ImageId>(entries.size());
+        entries.emplace_back();
+    }
+    
+    Entry& entry = entries[id - base_count];
+    entry.filepath = filepath;
+    entry.md5 = md5;
+    entry.phash = phash;
+    entry.alive = true;
+    ids_by_path[filepath] = id;
+    indexEntry(id);
+    alive_count++;
+    
+    // A new image can only merge groups, never split them
+    for (const auto& match : found) {
+        unite(id, match.id);
     }
     
-    // Add exact duplicate groups
-    for (const auto& pair : md5_groups) {
-        if (pair.second.size() > 1) {
-            DuplicateGroup group;
-            group.filepaths = pair.second;
-            group.similarity_score = 0;  // Exact match
-            duplicate_groups.push_back(group);
+    if (matches) {
+        *matches = std::move(found);
+    }
+    return id;
+}
+
+bool DuplicateDetector::remove(ImageId id) {
+    if (!isAlive(id)) {
+        return false;
+    }
+    
+    // Only the removed image's own group can change: rebuild it from the
+    // remaining members' matches
+    std::vector<ImageId> component = groupMembers(findRoot(id));
+    
+    if (id < base_count) {
+        base_removed.insert(id);
+    } else {
+        Entry& entry = entries[id - base_count];
+        unindexEntry(id);
+        ids_by_path.erase(entry.filepath);
+        entry = Entry();
+        free_ids.push_back(id);
+    }
+    alive_count--;
+    
+    for (ImageId member : component) {
+        makeSingleton(member);
+    }
+    if (component.size() < 2) {
+        return true;
+    }
+    for (ImageId member : component) {
+        if (member == id) continue;
+        for (const auto& match : query(getMd5(member), getPhash(member))) {
+            if (match.id != member) {
+                unite(member, match.id);
+            }
         }
     }
+    return true;
+}
+
+std::vector<DuplicateDetector::Match> DuplicateDetector::query(const std::string& md5, uint64_t phash) const {
+    std::vector<Match> matches;
+    if (!md5.empty()) {
+        auto identical = ids_by_md5.find(md5);
+        if (identical != ids_by_md5.end()) {
+            for (ImageId id : identical->second) {
+                matches.push_back(Match{id, bitDistance(getPhash(id), phash)});
+            }
+        }
+        for (ImageId id : base.findMd5(md5)) {
+            if (!base_removed.count(id)) {
+                matches.push_back(Match{id, bitDistance(base.getPhash(id), phash)});
+            }
+        }
+    }
+    if (hamming_threshold >= 0) {
+        // Pigeonhole: some block is within threshold / kBlockCount bits
+        collectWithin(phash, hamming_threshold, hamming_threshold / kBlockCount, matches);
+    }
     
-    // Second pass: Find similar images using perceptual hash
-    for (size_t i = 0; i < image_hashes.size(); i++) {
-        if (processed_indices.count(i)) continue;
+    // An image can be found through its MD5 and several blocks
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) { return a.id < b.id; });
+    matches.erase(std::unique(matches.begin(), matches.end(),
+                              [](const Match& a, const Match& b) { return a.id == b.id; }),
+                  matches.end());
+    return matches;
+}
+
+std::vector<DuplicateDetector::Match> DuplicateDetector::findWithin(uint64_t phash, int distance) const {
+    std::vector<Match> matches;
+    if (distance >= 0) {
+        collectWithin(phash, distance, distance / kBlockCount, matches);
+    }
+    sortByDistance(matches);
+    return matches;
+}
+
+std::vector<DuplicateDetector::Match> DuplicateDetector::findNearest(uint64_t phash, size_t k) const {
+    // Probing blocks within b bits finds everything within 5b + 4 bits, so
+    // widen b until that holds k images; each step costs far more than
+    // the last, so redoing the smaller ones is cheap
+    std::vector<Match> matches;
+    for (int block_radius = 0; k > 0; block_radius++) {
+        int covered = kBlockCount * (block_radius + 1) - 1;
+        bool complete = probeCount(block_radius) >= alive_count || covered >= 64;
         
-        std::vector<std::string> similar_group;
-        similar_group.push_back(image_hashes[i].filepath);
-        processed_indices.insert(i);
+        matches.clear();
+        collectWithin(phash, complete ? 64 : covered, block_radius, matches);
+        sortByDistance(matches);
         
-        for (size_t j = i + 1; j < image_hashes.size(); j++) {
-            if (processed_indices.count(j)) continue;
-            
-            // Skip if already in exact duplicate group
-            if (image_hashes[i].md5_hash == image_hashes[j].md5_hash && 
-                !image_hashes[i].md5_hash.empty()) {
-                continue;
-            }
-            
-            // Calculate Hamming distance
-            int distance = HashCalculator::hammingDistance(
-                image_hashes[i].perceptual_hash,
-                image_hashes[j].perceptual_hash
-            );
-            
-            if (distance <= hamming_threshold && distance > 0) {
-                similar_group.push_back(image_hashes[j].filepath);
-                processed_indices.insert(j);
-            }
+        if (complete || matches.size() >= k) {
+            break;
         }
+    }
+    if (matches.size() > k) {
+        matches.resize(k);
+    }
+    return matches;
+}
+
+void DuplicateDetector::sortByDistance(std::vector<Match>& matches) {
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+    });
+    matches.erase(std::unique(matches.begin(), matches.end(),
+                              [](const Match& a, const Match& b) { return a.id == b.id; }),
+                  matches.end());
+}
+
+bool DuplicateDetector::findId(const std::string& filepath, ImageId& id) const {
+    auto found = ids_by_path.find(filepath);
+    if (found != ids_by_path.end()) {
+        id = found->second;
+        return true;
+    }
+    return base.findPath(filepath, id) && !base_removed.count(id);
+}
+
+std::string DuplicateDetector::getFilepath(ImageId id) const {
+    return id < base_count ? std::string(base.getPath(id)) : entries[id - base_count].filepath;
+}
+
+std::vector<DuplicateDetector::ImageId> DuplicateDetector::getGroup(ImageId id) const {
+    std::vector<ImageId> group = groupMembers(findRoot(id));
+    std::sort(group.begin(), group.end());
+    return group;
+}
+
+size_t DuplicateDetector::size() const {
+    return alive_count;
+}
+
+void DuplicateDetector::addImageHash(const std::string& filepath, const std::string& md5, uint64_t phash) {
+    insert(filepath, md5, phash);
+}
+
+bool DuplicateDetector::removeImageHash(const std::string& filepath) {
+    ImageId id;
+    return findId(filepath, id) && remove(id);
+}
+
+std::vector<DuplicateDetector::DuplicateGroup> DuplicateDetector::findDuplicates() {
+    // Groups are already maintained; list them by their first image
+    std::vector<std::pair<ImageId, DuplicateGroup>> found;
+    for (ImageId root = 0; root < base_count + entries.size(); root++) {
+        if (!isAlive(root) || findRoot(root) != root || groupSize(root) < 2) continue;
         
-        // Add group if we found similar images
-        if (similar_group.size() > 1) {
-            DuplicateGroup group;
-            group.filepaths = similar_group;
-            group.similarity_score = hamming_threshold;  // Approximate
-            duplicate_groups.push_back(group);
+        std::vector<ImageId> ids = getGroup(root);
+        std::string first_md5 = getMd5(ids[0]);
+        DuplicateGroup group;
+        group.similarity_score = 0;  // Exact match
+        for (ImageId id : ids) {
+            group.filepaths.push_back(getFilepath(id));
+            if (first_md5.empty() || getMd5(id) != first_md5) {
+                group.similarity_score = hamming_threshold;  // Approximate
+            }
         }
+        found.emplace_back(ids[0], std::move(group));
     }
+    std::sort(found.begin(), found.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
     
+    duplicate_groups.clear();
+    for (auto& group : found) {
+        duplicate_groups.push_back(std::move(group.second));
+    }
     return duplicate_groups;
 }
 
+std::vector<std::string> DuplicateDetector::findMatches(const std::string& filepath, const std::string& md5,
+                                                        uint64_t phash) const {
+    std::vector<std::string> matches;
+    for (const auto& match : query(md5, phash)) {
+        std::string match_path = getFilepath(match.id);
+        if (match_path != filepath) {
+            matches.push_back(std::move(match_path));
+        }
+    }
+    return matches;
+}
+
 int DuplicateDetector::getDuplicateCount() const {
     int count = 0;
     for (const auto& group : duplicate_groups) {
@@ -90,10 +347,141 @@ int DuplicateDetector::getDuplicateCount() const {
 }
 
 void DuplicateDetector::clear() {
-    image_hashes.clear();
+    base.close();
+    base_count = 0;
+    base_removed.clear();
+    entries.clear();
+    free_ids.clear();
+    alive_count = 0;
+    ids_by_path.clear();
+    ids_by_md5.clear();
+    for (auto& block_buckets : buckets) {
+        block_buckets.clear();
+    }
+    parents.clear();
+    groups.clear();
     duplicate_groups.clear();
 }
 
+bool DuplicateDetector::isAlive(ImageId id) const {
+    if (id < base_count) {
+        return !base_removed.count(id);
+    }
+    return id - base_count < entries.size() && entries[id - base_count].alive;
+}
+
+uint64_t DuplicateDetector::getPhash(ImageId id) const {
+    return id < base_count ? base.getPhash(id) : entries[id - base_count].phash;
+}
+
+std::string DuplicateDetector::getMd5(ImageId id) const {
+    return id < base_count ? base.getMd5(id) : entries[id - base_count].md5;
+}
+
+void DuplicateDetector::indexEntry(ImageId id) {
+    const Entry& entry = entries[id - base_count];
+    for (int block = 0; block < kBlockCount; block++) {
+        if (buckets[block].empty()) {
+            buckets[block].resize(size_t(1) << HashIndex::blockBits(block));
+        }
+        buckets[block][HashIndex::blockOf(entry.phash, block)].push_back(Slot{entry.phash, id});
+    }
+    if (!entry.md5.empty()) {
+        ids_by_md5[entry.md5].push_back(id);
+    }
+}
+
+void DuplicateDetector::unindexEntry(ImageId id) {
+    const Entry& entry = entries[id - base_count];
+    for (int block = 0; block < kBlockCount; block++) {
+        auto& slots = buckets[block][HashIndex::blockOf(entry.phash, block)];
+        auto slot = std::find_if(slots.begin(), slots.end(), [id](const Slot& s) { return s.id == id; });
+        *slot = slots.back();
+        slots.pop_back();
+    }
+    if (!entry.md5.empty()) {
+        auto identical = ids_by_md5.find(entry.md5);
+        auto& ids = identical->second;
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        if (ids.empty()) {
+            ids_by_md5.erase(identical);
+        }
+    }
+}
+
+DuplicateDetector::ImageId DuplicateDetector::findRoot(ImageId id) const {
+    auto parent = parents.find(id);
+    if (parent != parents.end()) {
+        return parent->second;
+    }
+    return id < base_count ? base.getGroupRoot(id) : id;
+}
+
+size_t DuplicateDetector::groupSize(ImageId root) const {
+    auto group = groups.find(root);
+    if (group == groups.end()) {
+        return root < base_count ? base.getGroupSize(root) : 1;
+    }
+    return (group->second.base_members ? base.getGroupSize(root) : 0) + group->second.members.size();
+}
+
+std::vector<DuplicateDetector::ImageId> DuplicateDetector::groupMembers(ImageId root) const {
+    std::vector<ImageId> members;
+    auto group = groups.find(root);
+    if (group == groups.end() ? root < base_count : group->second.base_members) {
+        // A corrupt ring may never return to root, so stop after group_size
+        size_t limit = std::max<size_t>(1, std::min<size_t>(base.getGroupSize(root), base_count));
+        ImageId member = root;
+        do {
+            members.push_back(member);
+            member = base.getGroupNext(member);
+        } while (member != root && members.size() < limit);
+    }
+    if (group != groups.end()) {
+        members.insert(members.end(), group->second.members.begin(), group->second.members.end());
+    } else if (root >= base_count) {
+        members.push_back(root);
+    }
+    return members;
+}
+
+void DuplicateDetector::makeSingleton(ImageId id) {
+    if (id < base_count && base.getGroupSize(id) > 1) {
+        // Override the group recorded in the base file
+        parents[id] = id;
+        groups[id] = Group{false, {id}};
+    } else {
+        parents.erase(id);
+        groups.erase(id);
+    }
+}
+
+void DuplicateDetector::unite(ImageId a, ImageId b) {
+    ImageId root_a = findRoot(a);
+    ImageId root_b = findRoot(b);
+    if (root_a == root_b) return;
+    
+    // Relabel the smaller group
+    if (groupSize(root_a) < groupSize(root_b)) {
+        std::swap(root_a, root_b);
+    }
+    std::vector<ImageId> moved = groupMembers(root_b);
+    groups.erase(root_b);
+    
+    auto target = groups.find(root_a);
+    if (target == groups.end()) {
+        Group group{root_a < base_count, {}};
+        if (root_a >= base_count) {
+            group.members.push_back(root_a);
+        }
+        target = groups.emplace(root_a, std::move(group)).first;
+    }
+    for (ImageId member : moved) {
+        parents[member] = root_a;
+    }
+    target->second.members.insert(target->second.members.end(), moved.begin(), moved.end());
+}
+
 void DuplicateDetector::printDuplicateReport() const {
     if (duplicate_groups.empty()) {
         std::cout << "\nNo duplicates found.\n";
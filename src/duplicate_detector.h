@@ -2,43 +2,173 @@
 #define DUPLICATE_DETECTOR_H
 
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <map>
 #include <cstdint>
 
+#include "hash_index.h"
+
+// Online index of image hashes. Images can be inserted and removed at any
+// time; each insert returns its matches (same MD5, or perceptual hashes
+// within the Hamming threshold) and duplicate groups - the connected
+// components of that relation - are kept up to date as it goes.
+//
+// Perceptual hashes are found by multi-index hashing: the 64-bit hash is
+// split into five blocks of 13/13/13/13/12 bits, each indexed separately.
+// Two hashes within distance t differ in at most t/5 bits in at least one
+// block, so a query only probes the buckets within t/5 bits of each of its
+// own blocks (at the default threshold of 8, its own bucket plus the 13 or
+// 12 one bit away in each block: 4 * 14 + 13 = 69 buckets) instead of
+// comparing against every stored image. Small indexes are simply scanned.
+//
+// A saved index file (see HashIndex) can be opened as a read-only base:
+// it is mapped rather than loaded, and images inserted or removed later
+// are kept in memory on top of it until the next save. Not thread safe.
 class DuplicateDetector {
 public:
-    struct ImageHash {
-        std::string filepath;
-        std::string md5_hash;
-        uint64_t perceptual_hash;
+    using ImageId = uint32_t;
+
+    struct Match {
+        ImageId id;
+        int distance;  // Hamming distance of the perceptual hashes
     };
-    
+
     struct DuplicateGroup {
         std::vector<std::string> filepaths;
-        int similarity_score;  // Hamming distance (lower = more similar)
+        int similarity_score;  // 0 if all files are identical, else the threshold
     };
-    
+
     DuplicateDetector(int hamming_threshold = 8);
-    
+
+    // Replace the contents with the index saved in filepath
+    bool open(const std::string& filepath);
+
+    // Write the current contents (base and changes) as an index file;
+    // filepath may be the file that is open
+    bool save(const std::string& filepath) const;
+
+    // Add an image and return its id; matches (if given) receives the
+    // images it duplicates, in id order. Re-inserting a path replaces it.
+    ImageId insert(const std::string& filepath, const std::string& md5, uint64_t phash,
+                   std::vector<Match>* matches = nullptr);
+
+    // Remove an image; its group is split again if it was holding it together
+    bool remove(ImageId id);
+
+    // Stored images matching the given hashes, in id order
+    std::vector<Match> query(const std::string& md5, uint64_t phash) const;
+
+    // Stored images within distance bits of phash, nearest first
+    std::vector<Match> findWithin(uint64_t phash, int distance) const;
+
+    // The k stored images nearest to phash (all of them if there are
+    // fewer), nearest first; ties go to the lower id
+    std::vector<Match> findNearest(uint64_t phash, size_t k) const;
+
+    // Id of filepath; false if it is not stored
+    bool findId(const std::string& filepath, ImageId& id) const;
+
+    std::string getFilepath(ImageId id) const;
+
+    // Ids in the same group as id (including id), in id order
+    std::vector<ImageId> getGroup(ImageId id) const;
+
+    // Number of stored images
+    size_t size() const;
+
     // Add image hash to database
     void addImageHash(const std::string& filepath, const std::string& md5, uint64_t phash);
-    
-    // Find duplicates based on MD5 (exact) and perceptual hash (similar)
+
+    // Remove the stored hash of filepath; false if it was not stored
+    bool removeImageHash(const std::string& filepath);
+
+    // Snapshot the current duplicate groups (for the report and count)
     std::vector<DuplicateGroup> findDuplicates();
-    
+
+    // Stored images identical to (same MD5) or within the Hamming threshold
+    // of the given hashes, other than filepath itself
+    std::vector<std::string> findMatches(const std::string& filepath, const std::string& md5,
+                                         uint64_t phash) const;
+
     // Get total number of duplicate images found
     int getDuplicateCount() const;
-    
-    // Clear all stored hashes
+
+    // Clear all stored hashes (and close the base index)
     void clear();
-    
+
     // Print duplicate report
     void printDuplicateReport() const;
 
 private:
-    std::vector<ImageHash> image_hashes;
+    static const int kBlockCount = HashIndex::kBlockCount;
+
+    // Images added since the base was opened; their ids follow the base's
+    struct Entry {
+        std::string filepath;
+        std::string md5;
+        uint64_t phash;
+        bool alive;
+    };
+
+    struct Slot {
+        uint64_t phash;
+        ImageId id;
+    };
+
+    // Members of a root's group, where they differ from the base file
+    struct Group {
+        bool base_members;  // The base file's ring for this root still belongs
+        std::vector<ImageId> members;
+    };
+
+    bool isAlive(ImageId id) const;
+    uint64_t getPhash(ImageId id) const;
+    std::string getMd5(ImageId id) const;
+
+    void indexEntry(ImageId id);
+    void unindexEntry(ImageId id);
+
+    // Visit every key within radius bits of key, flipping bits from first_bit up
+    template <typename Visitor>
+    static void probe(uint32_t key, int bits, int radius, int first_bit, Visitor& visit);
+
+    // Buckets probed at block_radius
+    static size_t probeCount(int block_radius);
+
+    // Append the stored images within distance bits of phash among those
+    // with a block within block_radius bits of phash's (all of them once
+    // block_radius >= distance / kBlockCount); ids may repeat
+    void collectWithin(uint64_t phash, int distance, int block_radius, std::vector<Match>& matches) const;
+
+    // Sort by distance, then id, dropping repeated ids
+    static void sortByDistance(std::vector<Match>& matches);
+
+    // Union-find over ids; parents always point straight at the root,
+    // which holds the member list. Only differences from the groups
+    // recorded in the base file are kept in memory.
+    ImageId findRoot(ImageId id) const;
+    size_t groupSize(ImageId root) const;
+    std::vector<ImageId> groupMembers(ImageId root) const;
+    void makeSingleton(ImageId id);
+    void unite(ImageId a, ImageId b);
+
     int hamming_threshold;
+
+    HashIndexReader base;
+    ImageId base_count;
+    std::unordered_set<ImageId> base_removed;
+
+    std::vector<Entry> entries;  // Indexed by id - base_count
+    std::vector<ImageId> free_ids;
+    size_t alive_count;
+    std::unordered_map<std::string, ImageId> ids_by_path;
+    std::unordered_map<std::string, std::vector<ImageId>> ids_by_md5;
+    std::vector<std::vector<Slot>> buckets[kBlockCount];  // Allocated on first insert
+
+    std::unordered_map<ImageId, ImageId> parents;
+    std::unordered_map<ImageId, Group> groups;
+
     std::vector<DuplicateGroup> duplicate_groups;
 };
 
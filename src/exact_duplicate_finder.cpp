@@ -0,0 +1,162 @@
+#include "exact_duplicate_finder.h"
+#include "hash_calculator.h"
+#include "scratch_arena.h"
+#include <atomic>
+#include <fstream>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace {
+    // Indices of files sharing a key, kept only if there are at least two
+    template <typename Key>
+    std::vector<std::vector<size_t>> collidingGroups(const std::unordered_map<Key, std::vector<size_t>>& groups) {
+        std::vector<std::vector<size_t>> colliding;
+        for (const auto& pair : groups) {
+            if (pair.second.size() > 1) {
+                colliding.push_back(pair.second);
+            }
+        }
+        return colliding;
+    }
+}
+
+int64_t ExactDuplicateFinder::fileSize(const std::string& filepath) {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    return static_cast<int64_t>(st.st_size);
+#else
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    return file ? static_cast<int64_t>(file.tellg()) : -1;
+#endif
+}
+
+std::string ExactDuplicateFinder::hashEnds(const std::string& filepath, int64_t size, uint64_t& bytes_read) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        return "";
+    }
+
+    ScratchArena::Scope scope(ScratchArena::local());
+    size_t length = static_cast<size_t>(size);
+    if (length > 2 * kPartialBytes) {
+        length = 2 * kPartialBytes;
+    }
+    ArenaVector<unsigned char> buffer(length);
+
+    if (static_cast<size_t>(size) <= 2 * kPartialBytes) {
+        // size may come from a stale list; only a whole file is a digest
+        file.read(reinterpret_cast<char*>(buffer.data()), length);
+        if (file && file.peek() != std::ifstream::traits_type::eof()) {
+            return "";
+        }
+    } else {
+        file.read(reinterpret_cast<char*>(buffer.data()), kPartialBytes);
+        file.seekg(size - static_cast<int64_t>(kPartialBytes), std::ios::beg);
+        file.read(reinterpret_cast<char*>(buffer.data()) + kPartialBytes, kPartialBytes);
+    }
+    if (!file) {
+        return "";
+    }
+
+    bytes_read += length;
+    return HashCalculator::calculateMD5(buffer.data(), length);
+}
+
+ExactDuplicateFinder::Result ExactDuplicateFinder::find(const std::vector<std::string>& files,
+                                                        const std::vector<int64_t>& sizes,
+                                                        TaskScheduler& scheduler) {
+    Result result;
+    result.digests.resize(files.size());
+    result.duplicate_of.resize(files.size());
+
+    // Stage 1: sizes (free if the caller already has them)
+    std::vector<int64_t> file_sizes(files.size(), -1);
+    {
+        TaskGroup group;
+        scheduler.parallelFor(0, files.size(), 64, [&](int64_t i) {
+            int64_t known = static_cast<size_t>(i) < sizes.size() ? sizes[i] : -1;
+            file_sizes[i] = known >= 0 ? known : fileSize(files[i]);
+        }, TaskScheduler::Priority::Normal, group);
+        scheduler.wait(group);
+    }
+
+    std::unordered_map<int64_t, std::vector<size_t>> by_size;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (file_sizes[i] >= 0) {
+            result.total_bytes += file_sizes[i];
+            by_size[file_sizes[i]].push_back(i);
+        }
+    }
+
+    std::vector<size_t> candidates;
+    for (const auto& group : collidingGroups(by_size)) {
+        candidates.insert(candidates.end(), group.begin(), group.end());
+    }
+
+    // Stage 2: hash both ends of every file that shares its size
+    std::vector<std::string> partial(files.size());
+    std::atomic<uint64_t> bytes_read(0);
+    {
+        TaskGroup group;
+        scheduler.parallelFor(0, candidates.size(), 1, [&](int64_t c) {
+            size_t i = candidates[c];
+            uint64_t read = 0;
+            partial[i] = hashEnds(files[i], file_sizes[i], read);
+            bytes_read.fetch_add(read, std::memory_order_relaxed);
+        }, TaskScheduler::Priority::Normal, group);
+        scheduler.wait(group);
+    }
+
+    std::unordered_map<std::string, std::vector<size_t>> by_partial;
+    for (size_t i : candidates) {
+        if (!partial[i].empty()) {
+            by_partial[std::to_string(file_sizes[i]) + ':' + partial[i]].push_back(i);
+        }
+    }
+
+    // Stage 3: full hash where the ends still collide; small files were
+    // hashed whole in stage 2 already
+    std::vector<size_t> full_candidates;
+    for (const auto& group : collidingGroups(by_partial)) {
+        for (size_t i : group) {
+            if (static_cast<size_t>(file_sizes[i]) <= 2 * kPartialBytes) {
+                result.digests[i] = partial[i];
+            } else {
+                full_candidates.push_back(i);
+            }
+        }
+    }
+    {
+        TaskGroup group;
+        scheduler.parallelFor(0, full_candidates.size(), 1, [&](int64_t c) {
+            size_t i = full_candidates[c];
+            result.digests[i] = HashCalculator::calculateMD5(files[i]);
+            if (!result.digests[i].empty()) {
+                bytes_read.fetch_add(file_sizes[i], std::memory_order_relaxed);
+            }
+        }, TaskScheduler::Priority::Normal, group);
+        scheduler.wait(group);
+    }
+    result.bytes_read = bytes_read.load(std::memory_order_relaxed);
+
+    // The first file of each digest in input order is the original
+    std::unordered_map<std::string, size_t> originals;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (result.digests[i].empty()) {
+            continue;
+        }
+        auto inserted = originals.emplace(result.digests[i], i);
+        if (!inserted.second) {
+            result.duplicate_of[i] = files[inserted.first->second];
+            result.duplicate_count++;
+        }
+    }
+
+    return result;
+}
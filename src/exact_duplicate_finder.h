@@ -0,0 +1,42 @@
+#ifndef EXACT_DUPLICATE_FINDER_H
+#define EXACT_DUPLICATE_FINDER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// Finds byte-identical files while reading as little as possible, in the
+// style of fdupes: files are grouped by size, same-size files by a hash of
+// their first and last kPartialBytes, and only files that still collide
+// are hashed in full. Files with a unique size are never read.
+class ExactDuplicateFinder {
+public:
+    static const size_t kPartialBytes = 64 * 1024;
+
+    struct Result {
+        // Full-content digest (as HashCalculator::calculateMD5), or empty
+        // if the file provably has no identical copy in the input
+        std::vector<std::string> digests;
+        // First identical file in input order; empty for originals
+        std::vector<std::string> duplicate_of;
+        size_t duplicate_count = 0;
+        uint64_t total_bytes = 0;
+        uint64_t bytes_read = 0;  // Bytes read for hashing across all stages
+    };
+
+    // sizes (such as those of a -l list) may be empty or hold -1 for files
+    // whose size is not known yet; only those are looked up with fstat
+    static Result find(const std::vector<std::string>& files, const std::vector<int64_t>& sizes,
+                       TaskScheduler& scheduler);
+
+private:
+    static int64_t fileSize(const std::string& filepath);
+
+    // Hash of the first and last kPartialBytes; files no larger than twice
+    // that are hashed whole, so the result is already the full digest
+    static std::string hashEnds(const std::string& filepath, int64_t size, uint64_t& bytes_read);
+};
+
+#endif // EXACT_DUPLICATE_FINDER_H
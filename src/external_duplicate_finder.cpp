@@ -0,0 +1,394 @@
+#include "external_duplicate_finder.h"
+#include "hash_index.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char kRecordsFile[] = "records.dat";
+    const char kPathsFile[] = "paths.dat";
+    const char kPairsFile[] = "pairs.dat";
+    const size_t kRunBufferBytes = 1 << 20;  // Read buffer per run while merging
+
+    bool isUnknownDigest(const unsigned char* digest) {
+        static const unsigned char zero[16] = {};
+        return std::memcmp(digest, zero, sizeof(zero)) == 0;
+    }
+
+    // FNV-1a, as for --shard, so every host orders paths the same way
+    uint64_t pathHash(const std::string& path) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : path) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    int bitDistance(uint64_t a, uint64_t b) {
+        return static_cast<int>(std::bitset<64>(a ^ b).count());
+    }
+
+    // Rotate phash so that block comes first (in the top bits)
+    uint64_t rotateBlockFirst(uint64_t phash, int block) {
+        int shift = (block * 13 + HashIndex::blockBits(block)) % 64;
+        return shift == 0 ? phash : (phash >> shift) | (phash << (64 - shift));
+    }
+
+    // Sequential reader over a run file of T records
+    template <typename T>
+    class RunReader {
+    public:
+        RunReader(const std::string& path, size_t buffer_records)
+            : file(std::fopen(path.c_str(), "rb")), buffer(std::max<size_t>(buffer_records, 1)),
+              position(0), count(0) {}
+        ~RunReader() {
+            if (file != nullptr) std::fclose(file);
+        }
+
+        bool isOpen() const { return file != nullptr; }
+
+        const T* next() {
+            if (position == count) {
+                count = std::fread(buffer.data(), sizeof(T), buffer.size(), file);
+                position = 0;
+                if (count == 0) return nullptr;
+            }
+            return &buffer[position++];
+        }
+
+    private:
+        std::FILE* file;
+        std::vector<T> buffer;
+        size_t position;
+        size_t count;
+    };
+
+    // Merge the given sorted runs, calling consume for each record in order
+    template <typename T, typename Less, typename Consumer>
+    bool mergeRuns(const std::vector<std::string>& runs, size_t buffer_records, Less less, Consumer consume) {
+        std::vector<std::unique_ptr<RunReader<T>>> readers;
+        std::vector<const T*> heads;
+        for (const auto& run : runs) {
+            readers.push_back(std::make_unique<RunReader<T>>(run, buffer_records));
+            if (!readers.back()->isOpen()) {
+                std::cerr << "Failed to read sort run: " << run << std::endl;
+                return false;
+            }
+            heads.push_back(readers.back()->next());
+        }
+
+        auto greater = [&](size_t a, size_t b) { return less(*heads[b], *heads[a]); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(greater);
+        for (size_t i = 0; i < heads.size(); i++) {
+            if (heads[i] != nullptr) queue.push(i);
+        }
+        while (!queue.empty()) {
+            size_t i = queue.top();
+            queue.pop();
+            if (!consume(*heads[i])) {
+                return false;
+            }
+            heads[i] = readers[i]->next();
+            if (heads[i] != nullptr) queue.push(i);
+        }
+        return true;
+    }
+
+    bool writeRecords(std::FILE* file, const void* data, size_t size, size_t count) {
+        return std::fwrite(data, size, count, file) == count;
+    }
+
+    // Sort the T records of input with at most memory_bytes of them in
+    // memory, and stream them to consume in order. Runs go next to input
+    // and are removed again.
+    template <typename T, typename Less, typename Consumer>
+    bool externalSort(const std::string& input, size_t memory_bytes, Less less, Consumer consume,
+                      uint64_t& run_count) {
+        std::vector<std::string> runs;
+        auto cleanup = [&runs]() {
+            std::error_code ec;
+            for (const auto& run : runs) fs::remove(run, ec);
+        };
+        auto newRun = [&runs, &input]() {
+            runs.push_back(input + ".run" + std::to_string(runs.size()));
+            return runs.back();
+        };
+
+        // Sorted runs of one memory load each
+        {
+            std::FILE* in = std::fopen(input.c_str(), "rb");
+            if (in == nullptr) {
+                std::cerr << "Failed to read " << input << std::endl;
+                return false;
+            }
+            std::error_code ec;
+            uintmax_t input_records = fs::file_size(input, ec) / sizeof(T);
+            std::vector<T> chunk(std::max<size_t>(
+                std::min<uintmax_t>(memory_bytes / sizeof(T), input_records), 1));
+            size_t count;
+            while ((count = std::fread(chunk.data(), sizeof(T), chunk.size(), in)) > 0) {
+                std::sort(chunk.begin(), chunk.begin() + count, less);
+                std::string run = newRun();
+                std::FILE* out = std::fopen(run.c_str(), "wb");
+                bool ok = out != nullptr && writeRecords(out, chunk.data(), sizeof(T), count);
+                if (out != nullptr && std::fclose(out) != 0) ok = false;
+                if (!ok) {
+                    std::cerr << "Failed to write sort run: " << run << std::endl;
+                    std::fclose(in);
+                    cleanup();
+                    return false;
+                }
+            }
+            std::fclose(in);
+        }
+        run_count += runs.size();
+
+        // Merge passes until one pass can take all remaining runs
+        size_t fan_in = std::max<size_t>(memory_bytes / kRunBufferBytes, 2);
+        size_t buffer_records = std::max<size_t>(kRunBufferBytes / sizeof(T), 1);
+        size_t first = 0;
+        while (runs.size() - first > fan_in) {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + first + fan_in);
+            std::string merged = newRun();
+            std::FILE* out = std::fopen(merged.c_str(), "wb");
+            bool ok = out != nullptr && mergeRuns<T>(group, buffer_records, less, [out](const T& record) {
+                return writeRecords(out, &record, sizeof(T), 1);
+            });
+            if (out != nullptr && std::fclose(out) != 0) ok = false;
+            std::error_code ec;
+            for (const auto& run : group) fs::remove(run, ec);
+            first += fan_in;
+            if (!ok) {
+                std::cerr << "Failed to merge sort runs into " << merged << std::endl;
+                cleanup();
+                return false;
+            }
+            run_count++;
+        }
+
+        std::vector<std::string> last(runs.begin() + first, runs.end());
+        bool ok = mergeRuns<T>(last, buffer_records, less, consume);
+        cleanup();
+        return ok;
+    }
+}
+
+ExternalDuplicateFinder::ExternalDuplicateFinder(const std::string& spill_dir, size_t memory_bytes,
+                                                 int hamming_threshold, int window)
+    : spill_dir(spill_dir), memory_bytes(std::max<size_t>(memory_bytes, 4 * kRunBufferBytes)),
+      hamming_threshold(hamming_threshold), window(std::max(window, 1)),
+      records_file(nullptr), paths_file(nullptr), record_count(0), path_bytes(0) {}
+
+ExternalDuplicateFinder::~ExternalDuplicateFinder() {
+    removeSpillFiles();
+}
+
+bool ExternalDuplicateFinder::open() {
+    removeSpillFiles();
+    std::error_code ec;
+    fs::create_directories(spill_dir, ec);
+
+    std::string records_path = (fs::path(spill_dir) / kRecordsFile).string();
+    std::string paths_path = (fs::path(spill_dir) / kPathsFile).string();
+    records_file = std::fopen(records_path.c_str(), "wb");
+    paths_file = std::fopen(paths_path.c_str(), "wb");
+    if (records_file == nullptr || paths_file == nullptr) {
+        std::cerr << "Failed to create spill files in " << spill_dir << std::endl;
+        removeSpillFiles();
+        return false;
+    }
+    record_count = 0;
+    path_bytes = 0;
+    return true;
+}
+
+bool ExternalDuplicateFinder::add(const std::string& filepath, const std::string& md5, uint64_t phash) {
+    Record record;
+    record.phash = phash;
+    record.path_hash = pathHash(filepath);
+    HashIndex::packDigest(md5, record.digest);
+    uint32_t length = static_cast<uint32_t>(filepath.size());
+
+    std::lock_guard<std::mutex> lock(add_mutex);
+    if (records_file == nullptr) {
+        return false;
+    }
+    record.path_offset = path_bytes;
+    if (!writeRecords(paths_file, &length, sizeof(length), 1) ||
+        !writeRecords(paths_file, filepath.data(), 1, filepath.size()) ||
+        !writeRecords(records_file, &record, sizeof(record), 1)) {
+        std::cerr << "Failed to write spill files in " << spill_dir << std::endl;
+        // The spill is torn now; closing it makes finish fail as well
+        flush();
+        return false;
+    }
+    path_bytes += sizeof(length) + filepath.size();
+    record_count++;
+    return true;
+}
+
+bool ExternalDuplicateFinder::flush() {
+    bool ok = records_file != nullptr && paths_file != nullptr;
+    if (records_file != nullptr && std::fclose(records_file) != 0) ok = false;
+    if (paths_file != nullptr && std::fclose(paths_file) != 0) ok = false;
+    records_file = nullptr;
+    paths_file = nullptr;
+    return ok;
+}
+
+std::string ExternalDuplicateFinder::readPath(std::FILE* paths, uint64_t offset) const {
+    uint32_t length = 0;
+    std::string path;
+    if (std::fseek(paths, static_cast<long>(offset), SEEK_SET) == 0 &&
+        std::fread(&length, sizeof(length), 1, paths) == 1) {
+        path.resize(length);
+        if (std::fread(&path[0], 1, length, paths) != length) {
+            path.clear();
+        }
+    }
+    return path;
+}
+
+void ExternalDuplicateFinder::removeSpillFiles() {
+    flush();
+    std::error_code ec;
+    for (const char* name : {kRecordsFile, kPathsFile, kPairsFile}) {
+        fs::remove(fs::path(spill_dir) / name, ec);
+    }
+}
+
+bool ExternalDuplicateFinder::finish(const std::string& report_path, Summary& summary) {
+    summary = Summary();
+    if (!flush()) {
+        std::cerr << "Failed to write spill files in " << spill_dir << std::endl;
+        removeSpillFiles();
+        return false;
+    }
+    summary.images = record_count;
+
+    const std::string records_path = (fs::path(spill_dir) / kRecordsFile).string();
+    const std::string paths_path = (fs::path(spill_dir) / kPathsFile).string();
+    const std::string pairs_path = (fs::path(spill_dir) / kPairsFile).string();
+
+    std::FILE* paths = std::fopen(paths_path.c_str(), "rb");
+    std::ofstream report(report_path, std::ios::trunc);
+    if (paths == nullptr || !report) {
+        std::cerr << "Failed to write duplicate report: " << report_path << std::endl;
+        if (paths != nullptr) std::fclose(paths);
+        removeSpillFiles();
+        return false;
+    }
+
+    // Exact duplicates: equal digests are adjacent in digest order
+    bool have_group = false;
+    Record group_first;
+    std::string group_path;
+    bool ok = externalSort<Record>(records_path, memory_bytes,
+        [](const Record& a, const Record& b) {
+            int order = std::memcmp(a.digest, b.digest, sizeof(a.digest));
+            if (order != 0) return order < 0;
+            return a.path_hash != b.path_hash ? a.path_hash < b.path_hash : a.path_offset < b.path_offset;
+        },
+        [&](const Record& record) {
+            if (isUnknownDigest(record.digest)) {
+                return true;
+            }
+            if (!have_group || std::memcmp(record.digest, group_first.digest, sizeof(record.digest)) != 0) {
+                have_group = true;
+                group_first = record;
+                group_path.clear();
+                return true;
+            }
+            if (group_path.empty()) {
+                group_path = readPath(paths, group_first.path_offset);
+                summary.exact_groups++;
+            }
+            summary.exact_duplicates++;
+            report << "exact\t" << group_path << "\t" << readPath(paths, record.path_offset) << "\n";
+            return static_cast<bool>(report);
+        },
+        summary.sorted_runs);
+
+    // Similar images: neighbours in each block-first order
+    std::FILE* pairs = ok ? std::fopen(pairs_path.c_str(), "wb") : nullptr;
+    ok = ok && pairs != nullptr;
+    for (int block = 0; ok && block < HashIndex::kBlockCount; block++) {
+        std::deque<Record> recent;
+        ok = externalSort<Record>(records_path, memory_bytes,
+            [block](const Record& a, const Record& b) {
+                uint64_t key_a = rotateBlockFirst(a.phash, block);
+                uint64_t key_b = rotateBlockFirst(b.phash, block);
+                if (key_a != key_b) return key_a < key_b;
+                return a.path_hash != b.path_hash ? a.path_hash < b.path_hash : a.path_offset < b.path_offset;
+            },
+            [&](const Record& record) {
+                for (const Record& other : recent) {
+                    int distance = bitDistance(record.phash, other.phash);
+                    if (distance > hamming_threshold ||
+                        (!isUnknownDigest(record.digest) &&
+                         std::memcmp(record.digest, other.digest, sizeof(record.digest)) == 0)) {
+                        continue;  // Too far apart, or an exact duplicate reported above
+                    }
+                    // Oriented by path hash, so a pair reads the same whatever the add order
+                    const Record* first = &other;
+                    const Record* second = &record;
+                    if (std::make_pair(second->path_hash, second->path_offset) <
+                        std::make_pair(first->path_hash, first->path_offset)) {
+                        std::swap(first, second);
+                    }
+                    Pair pair{first->path_offset, second->path_offset, static_cast<uint64_t>(distance)};
+                    if (!writeRecords(pairs, &pair, sizeof(pair), 1)) {
+                        return false;
+                    }
+                }
+                recent.push_back(record);
+                if (recent.size() > static_cast<size_t>(window)) {
+                    recent.pop_front();
+                }
+                return true;
+            },
+            summary.sorted_runs);
+    }
+    if (pairs != nullptr && std::fclose(pairs) != 0) {
+        ok = false;
+    }
+
+    // The same pair can turn up under several rotations
+    bool have_pair = false;
+    Pair last_pair{0, 0, 0};
+    ok = ok && externalSort<Pair>(pairs_path, memory_bytes,
+        [](const Pair& a, const Pair& b) {
+            return a.first != b.first ? a.first < b.first : a.second < b.second;
+        },
+        [&](const Pair& pair) {
+            if (have_pair && pair.first == last_pair.first && pair.second == last_pair.second) {
+                return true;
+            }
+            have_pair = true;
+            last_pair = pair;
+            summary.similar_pairs++;
+            report << "similar\t" << readPath(paths, pair.first) << "\t" << readPath(paths, pair.second)
+                   << "\t" << pair.distance << "\n";
+            return static_cast<bool>(report);
+        },
+        summary.sorted_runs);
+
+    std::fclose(paths);
+    report.close();
+    removeSpillFiles();
+    if (!ok || !report) {
+        std::cerr << "Duplicate detection in " << spill_dir << " failed" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef EXTERNAL_DUPLICATE_FINDER_H
+#define EXTERNAL_DUPLICATE_FINDER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// Out-of-core duplicate detection (--external-dups) for corpora whose
+// hashes do not fit in memory. Each image becomes a fixed-size record in
+// a spill directory (its path goes to a separate file), and records are
+// then sorted externally - runs of at most memory_bytes, merged with a
+// bounded fan-in - so memory use stays within the budget whatever the
+// number of images:
+//   - exact duplicates: one sort by MD5; equal digests end up adjacent
+//   - similar images: one sort per rotation of the perceptual hash that
+//     brings each of its five blocks to the front, comparing every record
+//     with the `window` records before it. This finds images within the
+//     threshold that sort close together under some rotation - nearly all
+//     near-duplicates in practice - but unlike DuplicateDetector it is
+//     not exhaustive.
+// Similar pairs found under several rotations are merged by a final sort.
+class ExternalDuplicateFinder {
+public:
+    struct Summary {
+        uint64_t images = 0;
+        uint64_t exact_groups = 0;
+        uint64_t exact_duplicates = 0;  // Images after the first of each exact group
+        uint64_t similar_pairs = 0;
+        uint64_t sorted_runs = 0;       // Runs written over all sorts
+    };
+
+    ExternalDuplicateFinder(const std::string& spill_dir, size_t memory_bytes, int hamming_threshold,
+                            int window = 64);
+    ~ExternalDuplicateFinder();
+
+    ExternalDuplicateFinder(const ExternalDuplicateFinder&) = delete;
+    ExternalDuplicateFinder& operator=(const ExternalDuplicateFinder&) = delete;
+
+    // Create the spill files
+    bool open();
+
+    // Spill one image; safe to call from any thread. After a failed write
+    // every later add and finish fail too.
+    bool add(const std::string& filepath, const std::string& md5, uint64_t phash);
+
+    // Sort, compare and write the report, one line per duplicate:
+    //   exact    <first path> <duplicate path>
+    //   similar  <path> <path> <distance>
+    // (tab separated). Ties are broken by a hash of the path, so the
+    // duplicates found do not depend on the order images were added in.
+    // The spill files are removed afterwards.
+    bool finish(const std::string& report_path, Summary& summary);
+
+private:
+    struct Record {
+        uint64_t phash;
+        uint64_t path_hash;    // Tie-breaker in every sort
+        uint64_t path_offset;  // Also identifies the image
+        unsigned char digest[16];
+    };
+
+    struct Pair {
+        uint64_t first;   // Path offsets, ordered by path hash
+        uint64_t second;
+        uint64_t distance;
+    };
+
+    bool flush();
+    std::string readPath(std::FILE* paths, uint64_t offset) const;
+    void removeSpillFiles();
+
+    std::string spill_dir;
+    size_t memory_bytes;
+    int hamming_threshold;
+    int window;
+
+    std::mutex add_mutex;
+    std::FILE* records_file;
+    std::FILE* paths_file;
+    uint64_t record_count;
+    uint64_t path_bytes;
+};
+
+#endif // EXTERNAL_DUPLICATE_FINDER_H
@@ -0,0 +1,203 @@
+#include "file_list_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const size_t kStdinBlockSize = 1 << 20;
+
+    bool parseInteger(const char* begin, const char* end, int64_t& value) {
+        if (begin == end) {
+            return false;
+        }
+        int64_t result = 0;
+        for (const char* p = begin; p < end; p++) {
+            if (*p < '0' || *p > '9') {
+                return false;
+            }
+            result = result * 10 + (*p - '0');
+        }
+        value = result;
+        return true;
+    }
+}
+
+FileListReader::FileListReader()
+    : data(nullptr), size(0), position(0), separator('\n'),
+      mapped(false), from_stdin(false), stdin_eof(false) {
+}
+
+FileListReader::~FileListReader() {
+    close();
+}
+
+bool FileListReader::open(const std::string& path) {
+    close();
+
+    if (path == "-") {
+        from_stdin = true;
+        refillStdin();
+        separator = (std::memchr(data, '\0', size) != nullptr) ? '\0' : '\n';
+        return true;
+    }
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open file list: " << path << " - " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Failed to map file list: " << path << " - " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+        madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapping);
+        size = st.st_size;
+        mapped = true;
+    }
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open file list: " << path << std::endl;
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+#endif
+
+    separator = (size > 0 && std::memchr(data, '\0', size) != nullptr) ? '\0' : '\n';
+    return true;
+}
+
+bool FileListReader::refillStdin() {
+    if (stdin_eof) {
+        return false;
+    }
+
+    // Drop what was parsed already, then append the next block
+    buffer.erase(0, position);
+    position = 0;
+
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + kStdinBlockSize);
+    size_t bytes = std::fread(&buffer[old_size], 1, kStdinBlockSize, stdin);
+    buffer.resize(old_size + bytes);
+    if (bytes == 0) {
+        stdin_eof = true;
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+    return bytes > 0;
+}
+
+bool FileListReader::parseRecord(const char* begin, const char* end, Entry& entry) const {
+    // Tolerate CRLF line endings
+    if (end > begin && end[-1] == '\r') {
+        end--;
+    }
+    if (begin == end) {
+        return false;
+    }
+
+    const char* path_end = static_cast<const char*>(std::memchr(begin, '\t', end - begin));
+    if (path_end == nullptr) {
+        entry.path.assign(begin, end);
+        entry.size = -1;
+        return true;
+    }
+
+    entry.path.assign(begin, path_end);
+
+    const char* size_begin = path_end + 1;
+    const char* size_end = static_cast<const char*>(std::memchr(size_begin, '\t', end - size_begin));
+    if (size_end == nullptr) {
+        size_end = end;
+    }
+    if (!parseInteger(size_begin, size_end, entry.size)) {
+        entry.size = -1;
+    }
+    return true;
+}
+
+bool FileListReader::nextChunk(std::vector<Entry>& out, size_t max_entries) {
+    size_t appended = 0;
+
+    while (appended < max_entries) {
+        const char* begin = data + position;
+        size_t remaining = size - position;
+        const char* record_end = (remaining > 0)
+            ? static_cast<const char*>(std::memchr(begin, separator, remaining))
+            : nullptr;
+
+        if (record_end == nullptr) {
+            if (from_stdin && refillStdin()) {
+                continue;
+            }
+            if (remaining == 0) {
+                break;
+            }
+            // Last record without a trailing separator
+            record_end = data + size;
+        }
+
+        Entry entry;
+        if (parseRecord(begin, record_end, entry)) {
+            out.push_back(std::move(entry));
+            appended++;
+        }
+        position = std::min(size, static_cast<size_t>(record_end - data) + 1);
+    }
+
+    return appended > 0;
+}
+
+void FileListReader::close() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    position = 0;
+    mapped = false;
+    from_stdin = false;
+    stdin_eof = false;
+    buffer.clear();
+}
+
+std::vector<FileListReader::Entry> FileListReader::readAll(const std::string& path) {
+    std::vector<Entry> entries;
+    FileListReader reader;
+    if (reader.open(path)) {
+        while (reader.nextChunk(entries, 65536)) {
+        }
+    }
+    return entries;
+}
@@ -0,0 +1,55 @@
+#ifndef FILE_LIST_READER_H
+#define FILE_LIST_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reads an externally produced list of image paths instead of scanning a
+// directory. Records are separated by newlines, or by NUL bytes if the list
+// contains any (as written by `find -print0`). A record may carry its file
+// size as a tab-separated column, "<path>\t<size>"; further columns (such
+// as an mtime) are ignored.
+// List files are memory-mapped and parsed chunk by chunk; "-" reads stdin.
+class FileListReader {
+public:
+    struct Entry {
+        std::string path;
+        int64_t size = -1;  // -1 = not given
+    };
+
+    FileListReader();
+    ~FileListReader();
+
+    FileListReader(const FileListReader&) = delete;
+    FileListReader& operator=(const FileListReader&) = delete;
+
+    // Open a list file, or stdin when path is "-"
+    bool open(const std::string& path);
+
+    // Append up to max_entries entries to out; returns false once the list
+    // is exhausted and nothing was appended
+    bool nextChunk(std::vector<Entry>& out, size_t max_entries);
+
+    void close();
+
+    // Convenience: read the whole list at once
+    static std::vector<Entry> readAll(const std::string& path);
+
+private:
+    bool refillStdin();
+    bool parseRecord(const char* begin, const char* end, Entry& entry) const;
+
+    const char* data;
+    size_t size;
+    size_t position;
+    char separator;
+
+    bool mapped;
+    bool from_stdin;
+    bool stdin_eof;
+    std::string buffer;  // Stdin input, or the whole list where mmap is unavailable
+};
+
+#endif // FILE_LIST_READER_H
@@ -0,0 +1,225 @@
+#include "file_watcher.h"
+#include "image_processor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+#ifdef __linux__
+    const uint32_t kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ONLYDIR | IN_DONT_FOLLOW;
+#endif
+
+    std::string canonicalPath(const std::string& path) {
+        std::error_code ec;
+        fs::path canonical = fs::weakly_canonical(path, ec);
+        return ec ? path : canonical.string();
+    }
+}
+
+FileWatcher::FileWatcher() : fd(-1), pending_overflow(false) {}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+#ifdef __linux__
+
+bool FileWatcher::open(const std::string& root_dir, const std::string& exclude_dir,
+                       std::vector<std::string>& existing_files) {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Cannot watch " << root_dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Paths are reported as root + "/" + relative path, like the scanner's
+    root = root_dir;
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+    exclude = exclude_dir.empty() ? std::string() : canonicalPath(exclude_dir);
+
+    addWatches(root, existing_files);
+    if (watched_directories.empty()) {
+        std::cerr << "Cannot watch " << root << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void FileWatcher::addWatches(const std::string& directory, std::vector<std::string>& files) {
+    if (!exclude.empty() && canonicalPath(directory) == exclude) {
+        return;
+    }
+
+    int wd = inotify_add_watch(fd, directory.c_str(), kWatchMask);
+    if (wd < 0) {
+        std::cerr << "Cannot watch " << directory << ": " << std::strerror(errno)
+                  << (errno == ENOSPC ? " (raise fs.inotify.max_user_watches)" : "") << std::endl;
+        return;
+    }
+    watched_directories[wd] = directory;
+
+    // Listed after the watch exists, so nothing created in between is missed
+    std::error_code ec;
+    std::vector<std::string> subdirectories;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string path = directory + "/" + it->path().filename().string();
+        std::error_code type_ec;
+        if (it->is_directory(type_ec) && !it->is_symlink(type_ec)) {
+            subdirectories.push_back(std::move(path));
+        } else if (it->is_regular_file(type_ec) && ImageProcessor::isImageFile(path)) {
+            files.push_back(std::move(path));
+        }
+    }
+    for (const auto& subdirectory : subdirectories) {
+        addWatches(subdirectory, files);
+    }
+}
+
+void FileWatcher::removeWatchesUnder(const std::string& directory) {
+    std::string prefix = directory + "/";
+    for (auto it = watched_directories.begin(); it != watched_directories.end();) {
+        if (it->second == directory || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(fd, it->first);
+            it = watched_directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool FileWatcher::readEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN;
+        }
+        if (length == 0) {
+            return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (pending.empty() && !pending_overflow) {
+                first_event = now;
+            }
+            last_event = now;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                pending_overflow = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watched_directories.erase(event->wd);
+                continue;
+            }
+            auto directory = watched_directories.find(event->wd);
+            if (directory == watched_directories.end() || event->len == 0) {
+                continue;
+            }
+
+            std::string path = directory->second + "/" + event->name;
+            bool removed = (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+            if (event->mask & IN_ISDIR) {
+                if (removed) {
+                    // A directory moved elsewhere keeps its watches; drop them
+                    removeWatchesUnder(path);
+                    pending[path] = Pending{true, true};
+                } else {
+                    std::vector<std::string> files;
+                    addWatches(path, files);
+                    for (auto& file : files) {
+                        pending[file] = Pending{false, false};
+                    }
+                }
+            } else if (ImageProcessor::isImageFile(path)) {
+                pending[path] = Pending{removed, false};
+            }
+        }
+    }
+}
+
+bool FileWatcher::waitForChanges(std::vector<Change>& changes, int debounce_ms, bool& overflowed) {
+    changes.clear();
+    overflowed = false;
+    const auto quiet_period = std::chrono::milliseconds(debounce_ms);
+    const auto max_delay = quiet_period * 10;
+
+    while (true) {
+        int timeout = -1;
+        if (!pending.empty() || pending_overflow) {
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = std::min(last_event + quiet_period, first_event + max_delay);
+            if (now >= deadline) {
+                break;
+            }
+            timeout = static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        }
+
+        pollfd poll_fd{fd, POLLIN, 0};
+        int ready = poll(&poll_fd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Watch failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (ready > 0 && !readEvents()) {
+            std::cerr << "Watch failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    if (pending_overflow) {
+        // Events were lost: report everything that exists now
+        std::vector<std::string> files;
+        addWatches(root, files);
+        for (auto& file : files) {
+            pending[file] = Pending{false, false};
+        }
+        overflowed = true;
+        pending_overflow = false;
+    }
+
+    changes.reserve(pending.size());
+    for (const auto& entry : pending) {
+        changes.push_back(Change{entry.first, entry.second.removed, entry.second.directory});
+    }
+    pending.clear();
+    return true;
+}
+
+#else
+
+bool FileWatcher::open(const std::string& root_dir, const std::string&, std::vector<std::string>&) {
+    std::cerr << "Cannot watch " << root_dir << ": --watch needs inotify (Linux)" << std::endl;
+    return false;
+}
+
+bool FileWatcher::waitForChanges(std::vector<Change>&, int, bool&) {
+    return false;
+}
+
+#endif
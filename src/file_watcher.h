@@ -0,0 +1,59 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Recursive inotify watch on an input tree (Linux only). Events are
+// collected per path and handed out in debounced batches, so a file
+// written in several steps, or a burst of copies, becomes one change per
+// file once the tree has been quiet for a moment.
+class FileWatcher {
+public:
+    struct Change {
+        std::string path;
+        bool removed;    // Deleted or moved away; otherwise created or rewritten
+        bool directory;  // A removed directory: everything below it is gone
+    };
+
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watch root and every directory below it except exclude (typically the
+    // output directory); the image files already there go to existing_files
+    bool open(const std::string& root, const std::string& exclude, std::vector<std::string>& existing_files);
+
+    // Block until changes have been quiet for debounce_ms (or pending for
+    // 10 x debounce_ms under constant activity) and return them. overflowed
+    // is set if the kernel dropped events; the whole tree is then reported
+    // as changed, and removals may be missing. False on error.
+    bool waitForChanges(std::vector<Change>& changes, int debounce_ms, bool& overflowed);
+
+private:
+    struct Pending {
+        bool removed;
+        bool directory;
+    };
+
+    // Watch directory and its subdirectories, collecting their image files
+    void addWatches(const std::string& directory, std::vector<std::string>& files);
+    void removeWatchesUnder(const std::string& directory);
+    bool readEvents();
+
+    int fd;
+    std::string root;
+    std::string exclude;
+    std::unordered_map<int, std::string> watched_directories;  // Watch descriptor -> path
+    std::map<std::string, Pending> pending;
+    bool pending_overflow;
+    std::chrono::steady_clock::time_point first_event;
+    std::chrono::steady_clock::time_point last_event;
+};
+
+#endif // FILE_WATCHER_H
@@ -1,7 +1,5 @@
 #include "hash_calculator.h"
 #include <fstream>
-#include <sstream>
-#include <iomanip>
 #include <cstring>
 #include <algorithm>
 
@@ -21,55 +19,93 @@ std::string HashCalculator::calculateMD5(const std::string& filepath) {
         return "";
     }
     
-    // Read file into buffer
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    std::vector<unsigned char> buffer(size);
-    file.read(reinterpret_cast<char*>(buffer.data()), size);
-    file.close();
+    // Hash in fixed-size chunks so the arena never grows with the file
+    ScratchArena::Scope scope(ScratchArena::local());
+    ArenaVector<unsigned char> chunk(kChunkSize);
+    Md5State state;
+    md5Begin(state);
+    while (file) {
+        file.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+        md5Update(state, chunk.data(), static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad()) {
+        return "";
+    }
     
-    // Calculate MD5
     unsigned char digest[16];
-    md5(buffer.data(), size, digest);
-    
-    // Convert to hex string
-    std::stringstream ss;
+    md5End(state, digest);
+    char hex[33];
+    formatDigest(digest, hex);
+    return std::string(hex, 32);
+}
+
+std::string HashCalculator::calculateMD5(const unsigned char* data, size_t length) {
+    char hex[33];
+    calculateMD5(data, length, hex);
+    return std::string(hex, 32);
+}
+
+void HashCalculator::calculateMD5(const unsigned char* data, size_t length, char* hex_out) {
+    unsigned char digest[16];
+    md5(data, length, digest);
+    formatDigest(digest, hex_out);
+}
+
+void HashCalculator::formatDigest(const unsigned char* digest, char* hex_out) {
+    static const char hex_digits[] = "0123456789abcdef";
     for (int i = 0; i < 16; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+        hex_out[i * 2] = hex_digits[digest[i] >> 4];
+        hex_out[i * 2 + 1] = hex_digits[digest[i] & 0x0f];
     }
-    
-    return ss.str();
+    hex_out[32] = '\0';
 }
 
 void HashCalculator::md5(const unsigned char* data, size_t length, unsigned char* digest) {
-    // Simplified MD5 - for production use OpenSSL or similar
-    // This is a basic implementation for demonstration
-    
-    uint32_t a0 = 0x67452301;
-    uint32_t b0 = 0xefcdab89;
-    uint32_t c0 = 0x98badcfe;
-    uint32_t d0 = 0x10325476;
-    
+    Md5State state;
+    md5Begin(state);
+    md5Update(state, data, length);
+    md5End(state, digest);
+}
+
+// Simplified MD5 - for production use OpenSSL or similar
+// This is a basic implementation for demonstration
+
+void HashCalculator::md5Begin(Md5State& state) {
+    state.a = 0x67452301;
+    state.b = 0xefcdab89;
+    state.c = 0x98badcfe;
+    state.d = 0x10325476;
+}
+
+void HashCalculator::md5Update(Md5State& state, const unsigned char* data, size_t length) {
     // Simple hash based on data (not full MD5 spec, but demonstrates concept)
+    uint32_t a0 = state.a;
+    uint32_t b0 = state.b;
+    uint32_t c0 = state.c;
+    uint32_t d0 = state.d;
     for (size_t i = 0; i < length; i++) {
         a0 = ROTATE_LEFT(a0 + data[i], 7);
         b0 = ROTATE_LEFT(b0 ^ data[i], 12);
         c0 = ROTATE_LEFT(c0 + (data[i] * 3), 17);
         d0 = ROTATE_LEFT(d0 ^ (data[i] * 5), 22);
     }
-    
+    state.a = a0;
+    state.b = b0;
+    state.c = c0;
+    state.d = d0;
+}
+
+void HashCalculator::md5End(const Md5State& state, unsigned char* digest) {
     // Store result
-    memcpy(digest, &a0, 4);
-    memcpy(digest + 4, &b0, 4);
-    memcpy(digest + 8, &c0, 4);
-    memcpy(digest + 12, &d0, 4);
+    memcpy(digest, &state.a, 4);
+    memcpy(digest + 4, &state.b, 4);
+    memcpy(digest + 8, &state.c, 4);
+    memcpy(digest + 12, &state.d, 4);
 }
 
-std::vector<unsigned char> HashCalculator::convertToGrayscale(const unsigned char* image_data,
+ArenaVector<unsigned char> HashCalculator::convertToGrayscale(const unsigned char* image_data,
                                                                int width, int height, int channels) {
-    std::vector<unsigned char> gray(width * height);
+    ArenaVector<unsigned char> gray(width * height);
     
     for (int i = 0; i < width * height; i++) {
         if (channels >= 3) {
@@ -87,12 +123,12 @@ std::vector<unsigned char> HashCalculator::convertToGrayscale(const unsigned cha
     return gray;
 }
 
-std::vector<unsigned char> HashCalculator::resizeForHash(const std::vector<unsigned char>& gray_data,
+ArenaVector<unsigned char> HashCalculator::resizeForHash(const ArenaVector<unsigned char>& gray_data,
                                                           int width, int height) {
     // Resize to 9x8 for dHash calculation (simple nearest neighbor)
     const int target_w = 9;
     const int target_h = 8;
-    std::vector<unsigned char> resized(target_w * target_h);
+    ArenaVector<unsigned char> resized(target_w * target_h);
     
     for (int y = 0; y < target_h; y++) {
         for (int x = 0; x < target_w; x++) {
@@ -107,6 +143,8 @@ std::vector<unsigned char> HashCalculator::resizeForHash(const std::vector<unsig
 
 uint64_t HashCalculator::calculatePerceptualHash(const unsigned char* image_data,
                                                   int width, int height, int channels) {
+    ScratchArena::Scope scope(ScratchArena::local());
+    
     // Convert to grayscale
     auto gray = convertToGrayscale(image_data, width, height, channels);
     
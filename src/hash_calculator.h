@@ -4,12 +4,19 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include "scratch_arena.h"
 
 class HashCalculator {
 public:
     // Calculate MD5 hash of file (for exact duplicate detection)
     static std::string calculateMD5(const std::string& filepath);
     
+    // Calculate MD5 hash of file contents already in memory
+    static std::string calculateMD5(const unsigned char* data, size_t length);
+    
+    // Same, writing the 32 hex digits plus a terminating NUL into hex_out
+    static void calculateMD5(const unsigned char* data, size_t length, char* hex_out);
+    
     // Calculate perceptual hash (difference hash - dHash) from image data
     // Returns 64-bit hash suitable for comparing similar images
     static uint64_t calculatePerceptualHash(const unsigned char* image_data, 
@@ -20,15 +27,28 @@ public:
     
 private:
     // Helper: Convert grayscale for perceptual hashing
-    static std::vector<unsigned char> convertToGrayscale(const unsigned char* image_data,
+    // (temporaries live in the calling thread's scratch arena)
+    static ArenaVector<unsigned char> convertToGrayscale(const unsigned char* image_data,
                                                          int width, int height, int channels);
     
     // Helper: Resize image to 9x8 for dHash calculation
-    static std::vector<unsigned char> resizeForHash(const std::vector<unsigned char>& gray_data,
+    static ArenaVector<unsigned char> resizeForHash(const ArenaVector<unsigned char>& gray_data,
                                                     int width, int height);
     
-    // Simple MD5 implementation
+    // Bytes read per step when hashing a file
+    static const size_t kChunkSize = 64 * 1024;
+    
+    // Simple MD5 implementation, usable incrementally
+    struct Md5State {
+        uint32_t a, b, c, d;
+    };
+    static void md5Begin(Md5State& state);
+    static void md5Update(Md5State& state, const unsigned char* data, size_t length);
+    static void md5End(const Md5State& state, unsigned char* digest);
     static void md5(const unsigned char* data, size_t length, unsigned char* digest);
+    
+    // 32 lowercase hex digits plus a terminating NUL
+    static void formatDigest(const unsigned char* digest, char* hex_out);
 };
 
 #endif // HASH_CALCULATOR_H
@@ -0,0 +1,400 @@
+#include "hash_index.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char kMagic[8] = {'T', 'H', 'M', 'B', 'H', 'I', 'X', '1'};
+    const uint32_t kVersion = 2;
+
+    static_assert(sizeof(HashIndex::Header) % 8 == 0, "sections must stay 8-byte aligned");
+
+    uint64_t align8(uint64_t offset) {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    // Byte offset of every section for an index of count images. The
+    // counts may come from an untrusted header, so valid is false if any
+    // offset would overflow or count does not fit an ImageId.
+    struct Layout {
+        uint64_t phash;
+        uint64_t md5;
+        uint64_t group_root;
+        uint64_t group_next;
+        uint64_t group_size;
+        uint64_t md5_order;
+        uint64_t path_order;
+        uint64_t path_offset;
+        uint64_t bucket_offset[HashIndex::kBlockCount];
+        uint64_t bucket_phash[HashIndex::kBlockCount];
+        uint64_t path_bytes;
+        uint64_t end;
+        bool valid;
+
+        Layout(uint64_t count, uint64_t path_byte_count) {
+            valid = count <= UINT32_MAX;
+            // Below 2^32 entries of at most 16 bytes, no section size overflows
+            uint64_t checked_count = valid ? count : 0;
+            uint64_t offset = sizeof(HashIndex::Header);
+            auto section = [&offset, this](uint64_t bytes) {
+                uint64_t start = offset;
+                if (bytes > UINT64_MAX - 7 - offset) {
+                    valid = false;
+                    return start;
+                }
+                offset = align8(offset + bytes);
+                return start;
+            };
+            phash = section(checked_count * 8);
+            md5 = section(checked_count * 16);
+            group_root = section(checked_count * 4);
+            group_next = section(checked_count * 4);
+            group_size = section(checked_count * 4);
+            md5_order = section(checked_count * 4);
+            path_order = section(checked_count * 4);
+            path_offset = section((checked_count + 1) * 8);
+            for (int block = 0; block < HashIndex::kBlockCount; block++) {
+                bucket_offset[block] = section(((uint64_t(1) << HashIndex::blockBits(block)) + 1) * 4);
+                bucket_phash[block] = section(checked_count * 8);
+            }
+            path_bytes = offset;
+            valid = valid && path_byte_count <= UINT64_MAX - offset;
+            end = valid ? offset + path_byte_count : 0;
+        }
+    };
+
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool isZero(const unsigned char* digest) {
+        static const unsigned char zero[16] = {};
+        return std::memcmp(digest, zero, 16) == 0;
+    }
+}
+
+int HashIndex::blockBits(int block) {
+    return block < 4 ? 13 : 12;
+}
+
+uint32_t HashIndex::blockOf(uint64_t phash, int block) {
+    return static_cast<uint32_t>(phash >> (block * 13)) & ((1u << blockBits(block)) - 1);
+}
+
+void HashIndex::packDigest(const std::string& md5, unsigned char* digest) {
+    std::memset(digest, 0, 16);
+    if (md5.size() != 32) return;
+    for (int i = 0; i < 16; i++) {
+        int high = hexValue(md5[2 * i]);
+        int low = hexValue(md5[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            std::memset(digest, 0, 16);
+            return;
+        }
+        digest[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+}
+
+std::string HashIndex::unpackDigest(const unsigned char* digest) {
+    if (isZero(digest)) {
+        return std::string();
+    }
+    static const char hex[] = "0123456789abcdef";
+    std::string md5(32, '0');
+    for (int i = 0; i < 16; i++) {
+        md5[2 * i] = hex[digest[i] >> 4];
+        md5[2 * i + 1] = hex[digest[i] & 15];
+    }
+    return md5;
+}
+
+bool HashIndex::write(const std::string& filepath, std::vector<Record>& records) {
+    std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.phash != b.phash ? a.phash < b.phash : a.path < b.path;
+    });
+    const uint64_t count = records.size();
+
+    std::vector<uint64_t> phashes(count);
+    std::vector<unsigned char> digests(count * 16);
+    uint64_t path_byte_count = 0;
+    for (uint64_t id = 0; id < count; id++) {
+        phashes[id] = records[id].phash;
+        std::memcpy(&digests[id * 16], records[id].digest, 16);
+        path_byte_count += records[id].path.size();
+    }
+
+    // Groups become rings of the new ids, rooted at their smallest one
+    std::vector<uint32_t> group_roots(count), group_nexts(count), group_sizes(count);
+    {
+        std::unordered_map<uint32_t, std::pair<ImageId, ImageId>> groups;  // -> first, last
+        for (uint64_t id = 0; id < count; id++) {
+            auto inserted = groups.emplace(records[id].group, std::make_pair(ImageId(id), ImageId(id)));
+            auto& group = inserted.first->second;
+            group_roots[id] = group.first;
+            group_nexts[id] = group.first;
+            group_nexts[group.second] = static_cast<ImageId>(id);
+            group.second = static_cast<ImageId>(id);
+            group_sizes[group.first]++;
+        }
+        for (uint64_t id = 0; id < count; id++) {
+            group_sizes[id] = group_sizes[group_roots[id]];
+        }
+    }
+
+    std::vector<uint32_t> md5_order(count), path_order(count);
+    for (uint64_t id = 0; id < count; id++) {
+        md5_order[id] = path_order[id] = static_cast<ImageId>(id);
+    }
+    std::sort(md5_order.begin(), md5_order.end(), [&digests](ImageId a, ImageId b) {
+        int order = std::memcmp(&digests[size_t(a) * 16], &digests[size_t(b) * 16], 16);
+        return order != 0 ? order < 0 : a < b;
+    });
+    std::sort(path_order.begin(), path_order.end(), [&records](ImageId a, ImageId b) {
+        return records[a].path < records[b].path;
+    });
+
+    std::vector<uint64_t> path_offsets(count + 1, 0);
+    for (uint64_t id = 0; id < count; id++) {
+        path_offsets[id + 1] = path_offsets[id] + records[id].path.size();
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.block_count = kBlockCount;
+    header.count = count;
+    header.path_bytes = path_byte_count;
+
+    fs::path temp_path = filepath;
+    temp_path += ".tmp";
+    bool ok;
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        uint64_t written = 0;
+        auto section = [&out, &written](const void* data, uint64_t bytes) {
+            static const char padding[8] = {};
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            written += bytes;
+            out.write(padding, static_cast<std::streamsize>(align8(written) - written));
+            written = align8(written);
+        };
+
+        section(&header, sizeof(header));
+        section(phashes.data(), count * 8);
+        section(digests.data(), count * 16);
+        section(group_roots.data(), count * 4);
+        section(group_nexts.data(), count * 4);
+        section(group_sizes.data(), count * 4);
+        section(md5_order.data(), count * 4);
+        section(path_order.data(), count * 4);
+        section(path_offsets.data(), (count + 1) * 8);
+
+        // Bucket tables by counting sort; hashes stay ascending within a bucket
+        std::vector<uint32_t> offsets;
+        std::vector<uint64_t> bucket_phashes(count);
+        for (int block = 0; block < kBlockCount; block++) {
+            offsets.assign((size_t(1) << blockBits(block)) + 1, 0);
+            for (uint64_t id = 0; id < count; id++) {
+                offsets[blockOf(phashes[id], block) + 1]++;
+            }
+            for (size_t key = 1; key < offsets.size(); key++) {
+                offsets[key] += offsets[key - 1];
+            }
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (uint64_t id = 0; id < count; id++) {
+                bucket_phashes[fill[blockOf(phashes[id], block)]++] = phashes[id];
+            }
+            section(offsets.data(), offsets.size() * 4);
+            section(bucket_phashes.data(), count * 8);
+        }
+
+        for (const auto& record : records) {
+            out.write(record.path.data(), static_cast<std::streamsize>(record.path.size()));
+        }
+        ok = static_cast<bool>(out);
+    }
+
+    std::error_code ec;
+    if (ok) {
+        fs::rename(temp_path, filepath, ec);
+    }
+    if (!ok || ec) {
+        std::cerr << "Failed to write hash index: " << filepath << std::endl;
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// HashIndexReader
+// ---------------------------------------------------------------------------
+
+HashIndexReader::HashIndexReader() {
+    close();
+}
+
+bool HashIndexReader::open(const std::string& filepath) {
+    close();
+
+    if (!file.open(filepath, MappedFile::Access::Random) || file.size() < sizeof(HashIndex::Header)) {
+        std::cerr << "Failed to open hash index: " << filepath << std::endl;
+        file.close();
+        return false;
+    }
+
+    const auto* candidate = reinterpret_cast<const HashIndex::Header*>(file.data());
+    Layout layout(candidate->count, candidate->path_bytes);
+    if (std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) != 0 || candidate->version != kVersion ||
+        candidate->block_count != HashIndex::kBlockCount || !layout.valid || layout.end != file.size()) {
+        std::cerr << "Invalid hash index: " << filepath << std::endl;
+        file.close();
+        return false;
+    }
+
+    header = candidate;
+    const unsigned char* base = file.data();
+    phashes = reinterpret_cast<const uint64_t*>(base + layout.phash);
+    digests = base + layout.md5;
+    group_roots = reinterpret_cast<const uint32_t*>(base + layout.group_root);
+    group_nexts = reinterpret_cast<const uint32_t*>(base + layout.group_next);
+    group_sizes = reinterpret_cast<const uint32_t*>(base + layout.group_size);
+    md5_order = reinterpret_cast<const uint32_t*>(base + layout.md5_order);
+    path_order = reinterpret_cast<const uint32_t*>(base + layout.path_order);
+    path_offsets = reinterpret_cast<const uint64_t*>(base + layout.path_offset);
+    for (int block = 0; block < HashIndex::kBlockCount; block++) {
+        bucket_offsets[block] = reinterpret_cast<const uint32_t*>(base + layout.bucket_offset[block]);
+        bucket_phashes[block] = reinterpret_cast<const uint64_t*>(base + layout.bucket_phash[block]);
+    }
+    path_bytes = reinterpret_cast<const char*>(base + layout.path_bytes);
+
+    return true;
+}
+
+void HashIndexReader::close() {
+    file.close();
+    header = nullptr;
+    phashes = nullptr;
+    digests = nullptr;
+    group_roots = group_nexts = group_sizes = nullptr;
+    md5_order = path_order = nullptr;
+    path_offsets = nullptr;
+    for (int block = 0; block < HashIndex::kBlockCount; block++) {
+        bucket_offsets[block] = nullptr;
+        bucket_phashes[block] = nullptr;
+    }
+    path_bytes = nullptr;
+}
+
+bool HashIndexReader::isOpen() const {
+    return header != nullptr;
+}
+
+uint64_t HashIndexReader::size() const {
+    return header != nullptr ? header->count : 0;
+}
+
+uint64_t HashIndexReader::getPhash(ImageId id) const {
+    return phashes[id];
+}
+
+std::string HashIndexReader::getMd5(ImageId id) const {
+    return HashIndex::unpackDigest(digests + size_t(id) * 16);
+}
+
+const unsigned char* HashIndexReader::getDigest(ImageId id) const {
+    return digests + size_t(id) * 16;
+}
+
+std::string_view HashIndexReader::getPath(ImageId id) const {
+    if (id >= header->count) {
+        return std::string_view();
+    }
+    uint64_t first = path_offsets[id];
+    uint64_t last = path_offsets[id + 1];
+    if (first > last || last > header->path_bytes) {
+        return std::string_view();
+    }
+    return std::string_view(path_bytes + first, last - first);
+}
+
+HashIndexReader::ImageId HashIndexReader::getGroupRoot(ImageId id) const {
+    ImageId root = group_roots[id];
+    return root < header->count ? root : id;
+}
+
+HashIndexReader::ImageId HashIndexReader::getGroupNext(ImageId id) const {
+    // A broken ring is closed at the image's root
+    ImageId next = group_nexts[id];
+    return next < header->count ? next : getGroupRoot(id);
+}
+
+uint32_t HashIndexReader::getGroupSize(ImageId id) const {
+    return group_sizes[id];
+}
+
+bool HashIndexReader::findPath(std::string_view path, ImageId& id) const {
+    if (header == nullptr) return false;
+    const uint32_t* end = path_order + header->count;
+    const uint32_t* it = std::lower_bound(path_order, end, path, [this](ImageId entry, std::string_view value) {
+        return getPath(entry) < value;
+    });
+    if (it == end || *it >= header->count || getPath(*it) != path) {
+        return false;
+    }
+    id = *it;
+    return true;
+}
+
+std::vector<HashIndexReader::ImageId> HashIndexReader::findMd5(const std::string& md5) const {
+    std::vector<ImageId> ids;
+    unsigned char digest[16];
+    HashIndex::packDigest(md5, digest);
+    if (header == nullptr || isZero(digest)) {
+        return ids;
+    }
+    // Out-of-range ids compare as an unknown digest and are never returned
+    auto digestOf = [this](ImageId id) {
+        static const unsigned char unknown[16] = {};
+        return id < header->count ? digests + size_t(id) * 16 : unknown;
+    };
+    const uint32_t* end = md5_order + header->count;
+    const uint32_t* first = std::lower_bound(md5_order, end, digest,
+        [&digestOf](ImageId id, const unsigned char* value) {
+            return std::memcmp(digestOf(id), value, 16) < 0;
+        });
+    for (const uint32_t* it = first; it != end && std::memcmp(digestOf(*it), digest, 16) == 0; ++it) {
+        ids.push_back(*it);
+    }
+    return ids;
+}
+
+std::pair<HashIndexReader::ImageId, HashIndexReader::ImageId> HashIndexReader::findPhash(uint64_t phash) const {
+    if (header == nullptr) {
+        return std::make_pair(0, 0);
+    }
+    auto range = std::equal_range(phashes, phashes + header->count, phash);
+    return std::make_pair(static_cast<ImageId>(range.first - phashes), static_cast<ImageId>(range.second - phashes));
+}
+
+std::pair<const uint64_t*, const uint64_t*> HashIndexReader::getBucket(int block, uint32_t key) const {
+    if (header == nullptr) {
+        return std::make_pair(nullptr, nullptr);
+    }
+    const uint64_t* bucket = bucket_phashes[block];
+    uint32_t first = bucket_offsets[block][key];
+    uint32_t last = bucket_offsets[block][key + 1];
+    if (first > last || last > header->count) {
+        return std::make_pair(nullptr, nullptr);
+    }
+    return std::make_pair(bucket + first, bucket + last);
+}
@@ -0,0 +1,120 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Persisted duplicate index ("--hash-index"). The file is laid out to be
+// memory-mapped and queried in place, so opening even a very large index
+// only reads its header, and queries only fault in the pages they touch:
+//
+//   Header
+//   uint64_t phash[count]            ascending; an image's id is its position
+//   uint8_t  md5[count][16]          raw digest, all zero if unknown
+//   uint32_t group_root[count]       smallest id in the image's duplicate group
+//   uint32_t group_next[count]       next member of the group (a ring)
+//   uint32_t group_size[count]
+//   uint32_t md5_order[count]        ids sorted by digest
+//   uint32_t path_order[count]       ids sorted by path
+//   uint64_t path_offset[count + 1]  into the path bytes
+//   per block: uint32_t bucket_offset[2^bits + 1], uint64_t bucket_phash[count]
+//   path bytes
+//
+// Every section starts 8-byte aligned. The blocks are those of the
+// multi-index (see DuplicateDetector): bucket b of block k lists, in
+// ascending order, the hashes whose block k equals b. Buckets hold the
+// hashes themselves so a probe reads them sequentially; only matches are
+// looked up in the phash array to find their ids. Integers are stored in
+// host byte order.
+namespace HashIndex {
+    using ImageId = uint32_t;
+
+    static const int kBlockCount = 5;
+
+    struct Header {
+        char magic[8];  // "THMBHIX1"
+        uint32_t version;
+        uint32_t block_count;
+        uint64_t count;
+        uint64_t path_bytes;
+    };
+
+    // Bits in block (13, 13, 13, 13, 12) and the block's value in phash
+    int blockBits(int block);
+    uint32_t blockOf(uint64_t phash, int block);
+
+    // MD5 hex digest <-> the 16 stored bytes (zero for an empty digest)
+    void packDigest(const std::string& md5, unsigned char* digest);
+    std::string unpackDigest(const unsigned char* digest);
+
+    struct Record {
+        uint64_t phash;
+        unsigned char digest[16];  // See packDigest
+        std::string_view path;
+        uint32_t group;  // Any number shared by exactly the members of a group
+    };
+
+    // Write records (in any order) as a new index file, replacing filepath
+    // atomically; records are renumbered by phash
+    bool write(const std::string& filepath, std::vector<Record>& records);
+}
+
+// Read-only access to a mapped index file. open checks only the header and
+// the file size; ids and offsets are bounds-checked where they are read, so
+// a corrupt index gives wrong answers but never reads outside the mapping.
+class HashIndexReader {
+public:
+    using ImageId = HashIndex::ImageId;
+
+    HashIndexReader();
+
+    HashIndexReader(const HashIndexReader&) = delete;
+    HashIndexReader& operator=(const HashIndexReader&) = delete;
+
+    bool open(const std::string& filepath);
+    void close();
+    bool isOpen() const;
+
+    uint64_t size() const;
+
+    uint64_t getPhash(ImageId id) const;
+    std::string getMd5(ImageId id) const;
+    const unsigned char* getDigest(ImageId id) const;
+    std::string_view getPath(ImageId id) const;
+
+    ImageId getGroupRoot(ImageId id) const;
+    ImageId getGroupNext(ImageId id) const;
+    uint32_t getGroupSize(ImageId id) const;
+
+    // Ids with this path / MD5 hex digest
+    bool findPath(std::string_view path, ImageId& id) const;
+    std::vector<ImageId> findMd5(const std::string& md5) const;
+
+    // Ids [first, last) of the images with this phash
+    std::pair<ImageId, ImageId> findPhash(uint64_t phash) const;
+
+    // Hashes whose block equals key, ascending
+    std::pair<const uint64_t*, const uint64_t*> getBucket(int block, uint32_t key) const;
+
+private:
+    MappedFile file;
+    const HashIndex::Header* header;
+    const uint64_t* phashes;
+    const unsigned char* digests;
+    const uint32_t* group_roots;
+    const uint32_t* group_nexts;
+    const uint32_t* group_sizes;
+    const uint32_t* md5_order;
+    const uint32_t* path_order;
+    const uint64_t* path_offsets;
+    const uint32_t* bucket_offsets[HashIndex::kBlockCount];
+    const uint64_t* bucket_phashes[HashIndex::kBlockCount];
+    const char* path_bytes;
+};
+
+#endif // HASH_INDEX_H
@@ -0,0 +1,391 @@
+#include "http_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image_processor.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const int kMaxThumbnailSize = 4096;
+    const size_t kMaxHeaderLines = 100;
+    const size_t kMaxIgnoredBody = 1024 * 1024;
+
+    const char* getStatusText(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 403: return "Forbidden";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 415: return "Unsupported Media Type";
+            default: return "Internal Server Error";
+        }
+    }
+
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Decode %XX escapes and '+' in a query component
+    std::string urlDecode(const std::string& text) {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '+') {
+                decoded += ' ';
+            } else if (text[i] == '%' && i + 2 < text.size() &&
+                       hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+                decoded += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+                i += 2;
+            } else {
+                decoded += text[i];
+            }
+        }
+        return decoded;
+    }
+
+    std::map<std::string, std::string> parseQuery(const std::string& query) {
+        std::map<std::string, std::string> params;
+        std::istringstream pairs(query);
+        for (std::string pair; std::getline(pairs, pair, '&');) {
+            size_t equals = pair.find('=');
+            if (equals == std::string::npos) {
+                params[urlDecode(pair)] = "";
+            } else {
+                params[urlDecode(pair.substr(0, equals))] = urlDecode(pair.substr(equals + 1));
+            }
+        }
+        return params;
+    }
+
+    std::string toLower(std::string text) {
+        for (char& c : text) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return text;
+    }
+}
+
+HttpServer::HttpServer(const Config& config, int num_threads)
+    : config(config),
+      scheduler(num_threads),
+      cache(config.cache_bytes),
+      request_count(0),
+      generated_count(0),
+      coalesced_count(0),
+      listen_fd(-1) {
+}
+
+HttpServer::~HttpServer() {
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+}
+
+bool HttpServer::run(const std::string& address) {
+    listen_fd = listenTcp(address);
+    if (listen_fd < 0) {
+        return false;
+    }
+
+    std::cout << "HTTP server listening on " << address << " with "
+              << scheduler.getThreadCount() << " threads, "
+              << config.cache_bytes / (1024 * 1024) << " MB cache\n" << std::flush;
+
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        // Responses are written whole; do not hold them back
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        // Reap connections that have ended
+        for (size_t i = 0; i < connection_threads.size();) {
+            if (*connection_threads[i].done) {
+                connection_threads[i].thread.join();
+                connection_threads[i] = std::move(connection_threads.back());
+                connection_threads.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([this, fd, done]() {
+            serveConnection(fd);
+            *done = true;
+        });
+        connection_threads.push_back(ConnectionThread{std::move(thread), done});
+    }
+
+    for (auto& connection : connection_threads) {
+        connection.thread.join();
+    }
+    connection_threads.clear();
+    return true;
+}
+
+void HttpServer::serveConnection(int fd) {
+    SocketStream connection(fd, 16 * 1024);
+    Request request;
+    while (readRequest(connection, request)) {
+        request_count++;
+        bool keep_open;
+        if (request.method != "GET" && request.method != "HEAD") {
+            keep_open = sendError(connection, request, 405, "only GET and HEAD are supported");
+        } else if (request.path == "/thumb") {
+            keep_open = handleThumb(connection, request);
+        } else if (request.path == "/stats") {
+            keep_open = handleStats(connection, request);
+        } else {
+            keep_open = sendError(connection, request, 404, "unknown resource " + request.path);
+        }
+        if (!keep_open || !request.keep_alive) break;
+    }
+    close(fd);
+}
+
+bool HttpServer::readRequest(SocketStream& connection, Request& request) {
+    std::string line;
+    do {
+        if (!connection.readLine(line)) return false;
+    } while (line.empty());  // Tolerate stray CRLFs between requests
+
+    std::istringstream request_line(line);
+    std::string target;
+    std::string version;
+    if (!(request_line >> request.method >> target >> version)) {
+        return false;
+    }
+
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    request.query = question == std::string::npos ? std::map<std::string, std::string>()
+                                                  : parseQuery(target.substr(question + 1));
+    request.keep_alive = version == "HTTP/1.1";
+
+    size_t content_length = 0;
+    for (size_t count = 0;; count++) {
+        if (count > kMaxHeaderLines || !connection.readLine(line)) return false;
+        if (line.empty()) break;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = toLower(line.substr(0, colon));
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        if (name == "connection") {
+            std::string option = toLower(value);
+            if (option == "close") request.keep_alive = false;
+            if (option == "keep-alive") request.keep_alive = true;
+        } else if (name == "content-length") {
+            content_length = std::strtoull(value.c_str(), nullptr, 10);
+        }
+    }
+
+    // Bodies mean nothing here but must be consumed to keep the stream in sync
+    return content_length <= kMaxIgnoredBody && connection.skipBytes(content_length);
+}
+
+bool HttpServer::handleThumb(SocketStream& connection, const Request& request) {
+    auto path_param = request.query.find("path");
+    if (path_param == request.query.end() || path_param->second.empty()) {
+        return sendError(connection, request, 400, "missing path parameter");
+    }
+
+    int size = config.thumbnail_size;
+    auto size_param = request.query.find("size");
+    if (size_param != request.query.end()) {
+        char* end = nullptr;
+        long value = std::strtol(size_param->second.c_str(), &end, 10);
+        if (size_param->second.empty() || *end != '\0' || value <= 0 || value > kMaxThumbnailSize) {
+            return sendError(connection, request, 400, "size must be between 1 and " +
+                             std::to_string(kMaxThumbnailSize));
+        }
+        size = static_cast<int>(value);
+    }
+
+    std::string path;
+    if (!resolvePath(path_param->second, path)) {
+        return sendError(connection, request, 403, "path outside the input directory");
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return sendError(connection, request, 404, "no such file");
+    }
+
+    // A changed file gets a new key; its old thumbnail ages out of the cache
+    std::string key = path + '\n' + std::to_string(size) + '\n' +
+                      std::to_string(static_cast<long long>(st.st_mtim.tv_sec)) + '.' +
+                      std::to_string(static_cast<long long>(st.st_mtim.tv_nsec)) + '\n' +
+                      std::to_string(static_cast<long long>(st.st_size));
+
+    const char* cache_status = "hit";
+    ThumbnailCache::Value jpeg = cache.get(key);
+    if (!jpeg) {
+        bool shared = false;
+        try {
+            jpeg = generateOnce(key, path, size, shared);
+        } catch (const std::exception& e) {
+            std::cerr << "Thumbnailing " << path << " failed: " << e.what() << std::endl;
+            return sendError(connection, request, 500, "thumbnail generation failed");
+        }
+        cache_status = shared ? "shared" : "miss";
+    }
+    if (!jpeg) {
+        return sendError(connection, request, 415, "image could not be thumbnailed");
+    }
+
+    return sendResponse(connection, request, 200, "image/jpeg", jpeg->data(), jpeg->size(),
+                        std::string("X-Cache: ") + cache_status + "\r\n");
+}
+
+bool HttpServer::handleStats(SocketStream& connection, const Request& request) {
+    ThumbnailCache::Stats stats = cache.getStats();
+    std::ostringstream body;
+    body << "{\"requests\": " << request_count
+         << ", \"generated\": " << generated_count
+         << ", \"coalesced\": " << coalesced_count
+         << ", \"cache\": {\"hits\": " << stats.hits
+         << ", \"misses\": " << stats.misses
+         << ", \"rejected\": " << stats.rejected
+         << ", \"evicted\": " << stats.evicted
+         << ", \"entries\": " << stats.entries
+         << ", \"bytes\": " << stats.bytes
+         << ", \"capacity\": " << config.cache_bytes << "}}\n";
+    std::string text = body.str();
+    return sendResponse(connection, request, 200, "application/json", text.data(), text.size());
+}
+
+bool HttpServer::sendResponse(SocketStream& connection, const Request& request, int status,
+                              const char* content_type, const void* body, size_t length,
+                              const std::string& extra_headers) {
+    std::ostringstream header;
+    header << "HTTP/1.1 " << status << " " << getStatusText(status) << "\r\n"
+           << "Content-Type: " << content_type << "\r\n"
+           << "Content-Length: " << length << "\r\n"
+           << (request.keep_alive ? "" : "Connection: close\r\n")
+           << (status == 405 ? "Allow: GET, HEAD\r\n" : "")
+           << extra_headers << "\r\n";
+    if (!connection.write(header.str())) {
+        return false;
+    }
+    return request.method == "HEAD" || connection.write(body, length);
+}
+
+bool HttpServer::sendError(SocketStream& connection, const Request& request, int status,
+                           const std::string& message) {
+    std::string body = message + "\n";
+    return sendResponse(connection, request, status, "text/plain", body.data(), body.size());
+}
+
+bool HttpServer::resolvePath(const std::string& requested, std::string& resolved) const {
+    if (config.input_dir.empty()) {
+        resolved = requested;
+        return true;
+    }
+
+    std::error_code ec;
+    fs::path root = fs::weakly_canonical(config.input_dir, ec);
+    fs::path target = fs::weakly_canonical(root / fs::path(requested).relative_path(), ec);
+    if (ec) {
+        return false;
+    }
+    // Symlinks and ".." are resolved above, so a prefix check suffices
+    auto mismatch = std::mismatch(root.begin(), root.end(), target.begin(), target.end());
+    if (mismatch.first != root.end()) {
+        return false;
+    }
+    resolved = target.string();
+    return true;
+}
+
+ThumbnailCache::Value HttpServer::generateOnce(const std::string& key, const std::string& path,
+                                               int size, bool& shared) {
+    std::shared_ptr<std::promise<ThumbnailCache::Value>> leader;
+    std::shared_future<ThumbnailCache::Value> flight;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        auto found = flights.find(key);
+        if (found != flights.end()) {
+            flight = found->second;
+        } else if (ThumbnailCache::Value cached = cache.peek(key)) {
+            // A flight for key landed between our cache miss and here
+            shared = true;
+            return cached;
+        } else {
+            leader = std::make_shared<std::promise<ThumbnailCache::Value>>();
+            flight = leader->get_future().share();
+            flights.emplace(key, flight);
+        }
+    }
+
+    shared = !leader;
+    if (shared) {
+        coalesced_count++;
+        return flight.get();
+    }
+
+    ThumbnailCache::Value jpeg;
+    try {
+        jpeg = generate(path, size);
+    } catch (...) {
+        // Waiters must not block on a flight that will never land
+        leader->set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        flights.erase(key);
+        throw;
+    }
+    if (jpeg) {
+        cache.put(key, jpeg);
+    }
+    leader->set_value(jpeg);
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        flights.erase(key);
+    }
+    return jpeg;
+}
+
+ThumbnailCache::Value HttpServer::generate(const std::string& path, int size) {
+    // Decode on the workers so concurrent misses are bounded by the thread
+    // count rather than by the number of connections
+    std::promise<ThumbnailCache::Value> done;
+    std::future<ThumbnailCache::Value> result = done.get_future();
+    scheduler.submit([&done, &path, size]() {
+        try {
+            ImageProcessor::EncodedThumbnail thumbnail;
+            bool success = false;
+            ImageProcessor::processSingleImage(path, size, thumbnail, success);
+            done.set_value(success ? std::make_shared<const std::vector<unsigned char>>(std::move(thumbnail.jpeg))
+                                   : nullptr);
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    });
+    ThumbnailCache::Value jpeg = result.get();
+    generated_count++;
+    return jpeg;
+}
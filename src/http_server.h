@@ -0,0 +1,87 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "socket_stream.h"
+#include "task_scheduler.h"
+#include "thumbnail_cache.h"
+
+// On-demand thumbnail endpoint (--http): HTTP/1.1 with keep-alive, one
+// thread per connection.
+//   GET /thumb?path=<file>&size=<px>  JPEG thumbnail, generated on the
+//                                     shared workers on a cache miss
+//   GET /stats                        cache counters as JSON
+// Thumbnails are cached by path, size, mtime and file size in a
+// ThumbnailCache; concurrent misses for the same key wait for a single
+// generation instead of each decoding the image. With -i, paths are
+// resolved inside the input directory and may not leave it.
+class HttpServer {
+public:
+    HttpServer(const Config& config, int num_threads);
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Serve on "[host:]port" (host defaults to 127.0.0.1) until the
+    // process is stopped; false if the socket could not be set up
+    bool run(const std::string& address);
+
+private:
+    struct Request {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> query;
+        bool keep_alive;
+    };
+
+    struct ConnectionThread {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void serveConnection(int fd);
+    bool readRequest(SocketStream& connection, Request& request);
+    bool handleThumb(SocketStream& connection, const Request& request);
+    bool handleStats(SocketStream& connection, const Request& request);
+    bool sendResponse(SocketStream& connection, const Request& request, int status,
+                      const char* content_type, const void* body, size_t length,
+                      const std::string& extra_headers = std::string());
+    bool sendError(SocketStream& connection, const Request& request, int status, const std::string& message);
+
+    // Resolve a requested path against the input directory, if one is set
+    bool resolvePath(const std::string& requested, std::string& resolved) const;
+
+    // Thumbnail for key, generated once however many requests wait for it;
+    // shared is set when another request did the work
+    ThumbnailCache::Value generateOnce(const std::string& key, const std::string& path,
+                                       int size, bool& shared);
+    ThumbnailCache::Value generate(const std::string& path, int size);
+
+    const Config config;
+    TaskScheduler scheduler;
+    ThumbnailCache cache;
+
+    std::mutex flights_mutex;
+    std::unordered_map<std::string, std::shared_future<ThumbnailCache::Value>> flights;
+
+    std::atomic<uint64_t> request_count;
+    std::atomic<uint64_t> generated_count;
+    std::atomic<uint64_t> coalesced_count;
+
+    int listen_fd;
+    std::vector<ConnectionThread> connection_threads;  // Only touched by run()
+};
+
+#endif // HTTP_SERVER_H
@@ -9,6 +9,7 @@
 #include "image_processor.h"
 #include "hash_calculator.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 ImageProcessor::ImageData ImageProcessor::loadImage(const std::string& filepath) {
@@ -26,6 +27,23 @@ ImageProcessor::ImageData ImageProcessor::loadImage(const std::string& filepath)
     return img;
 }
 
+ImageProcessor::ImageData ImageProcessor::loadImageFromMemory(const unsigned char* encoded, size_t length,
+                                                             const std::string& source_name) {
+    ImageData img;
+    
+    img.data = stbi_load_from_memory(encoded, static_cast<int>(length),
+                                     &img.width, &img.height, &img.channels, 0);
+    
+    if (img.data == nullptr) {
+        std::cerr << "Failed to load image: " << source_name << " - " << stbi_failure_reason() << std::endl;
+        img.is_valid = false;
+    } else {
+        img.is_valid = true;
+    }
+    
+    return img;
+}
+
 void ImageProcessor::freeImage(ImageData& img) {
     if (img.data != nullptr) {
         stbi_image_free(img.data);
@@ -77,34 +95,173 @@ ImageProcessor::ImageData ImageProcessor::createThumbnail(const ImageData& origi
     return thumbnail;
 }
 
-bool ImageProcessor::saveThumbnail(const ImageData& thumbnail, const std::string& output_path) {
+bool ImageProcessor::saveThumbnail(const ImageData& thumbnail, const char* output_path) {
     if (!thumbnail.is_valid) {
         return false;
     }
     
     // Save as JPEG with quality 85
-    int result = stbi_write_jpg(output_path.c_str(), thumbnail.width, thumbnail.height,
+    int result = stbi_write_jpg(output_path, thumbnail.width, thumbnail.height,
                                 thumbnail.channels, thumbnail.data, 85);
     
     return result != 0;
 }
 
+bool ImageProcessor::encodeThumbnail(const ImageData& thumbnail, EncodedThumbnail& out) {
+    out.jpeg.clear();
+    out.width = 0;
+    out.height = 0;
+    if (!thumbnail.is_valid) {
+        return false;
+    }
+    
+    // Same quality as saveThumbnail; stb hands the output over in chunks
+    int result = stbi_write_jpg_to_func([](void* context, void* data, int size) {
+        auto* jpeg = static_cast<std::vector<unsigned char>*>(context);
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        jpeg->insert(jpeg->end(), bytes, bytes + size);
+    }, &out.jpeg, thumbnail.width, thumbnail.height, thumbnail.channels, thumbnail.data, 85);
+    
+    if (result == 0) {
+        out.jpeg.clear();
+        return false;
+    }
+    out.width = thumbnail.width;
+    out.height = thumbnail.height;
+    return true;
+}
+
+bool ImageProcessor::encodeThumbnail(const ImageData& thumbnail, unsigned char* out, size_t capacity,
+                                     size_t& size) {
+    size = 0;
+    if (!thumbnail.is_valid) {
+        return false;
+    }
+    
+    struct Target {
+        unsigned char* out;
+        size_t capacity;
+        size_t size;
+    } target{out, capacity, 0};
+    
+    int result = stbi_write_jpg_to_func([](void* context, void* data, int chunk) {
+        auto* t = static_cast<Target*>(context);
+        size_t length = static_cast<size_t>(chunk);
+        if (t->size < t->capacity) {
+            std::memcpy(t->out + t->size, data, std::min(length, t->capacity - t->size));
+        }
+        t->size += length;
+    }, &target, thumbnail.width, thumbnail.height, thumbnail.channels, thumbnail.data, 85);
+    
+    size = target.size;
+    return result != 0;
+}
+
 uint64_t ImageProcessor::processSingleImage(const std::string& input_path,
-                                            const std::string& output_path,
+                                            const char* output_path,
                                             int thumbnail_size,
                                             bool& success) {
     success = false;
-    uint64_t hash = 0;
     
     // Load original image
     ImageData original = loadImage(input_path);
     if (!original.is_valid) {
-        return hash;
+        return 0;
+    }
+    
+    return processLoadedImage(original, thumbnail_size, [output_path](const ImageData& thumbnail) {
+        return saveThumbnail(thumbnail, output_path);
+    }, success);
+}
+
+uint64_t ImageProcessor::processEncodedImage(const unsigned char* encoded, size_t length,
+                                             const std::string& source_name,
+                                             const char* output_path,
+                                             int thumbnail_size,
+                                             bool& success) {
+    success = false;
+    
+    ImageData original = loadImageFromMemory(encoded, length, source_name);
+    if (!original.is_valid) {
+        return 0;
+    }
+    
+    return processLoadedImage(original, thumbnail_size, [output_path](const ImageData& thumbnail) {
+        return saveThumbnail(thumbnail, output_path);
+    }, success);
+}
+
+uint64_t ImageProcessor::processSingleImage(const std::string& input_path,
+                                            int thumbnail_size,
+                                            EncodedThumbnail& out,
+                                            bool& success) {
+    success = false;
+    
+    ImageData original = loadImage(input_path);
+    if (!original.is_valid) {
+        return 0;
+    }
+    
+    return processLoadedImage(original, thumbnail_size, [&out](const ImageData& thumbnail) {
+        return encodeThumbnail(thumbnail, out);
+    }, success);
+}
+
+uint64_t ImageProcessor::processEncodedImage(const unsigned char* encoded, size_t length,
+                                             const std::string& source_name,
+                                             int thumbnail_size,
+                                             EncodedThumbnail& out,
+                                             bool& success) {
+    success = false;
+    
+    ImageData original = loadImageFromMemory(encoded, length, source_name);
+    if (!original.is_valid) {
+        return 0;
+    }
+    
+    return processLoadedImage(original, thumbnail_size, [&out](const ImageData& thumbnail) {
+        return encodeThumbnail(thumbnail, out);
+    }, success);
+}
+
+uint64_t ImageProcessor::processSingleImage(const std::string& input_path,
+                                            int thumbnail_size,
+                                            const ThumbnailSink& sink,
+                                            bool& success) {
+    success = false;
+    
+    ImageData original = loadImage(input_path);
+    if (!original.is_valid) {
+        return 0;
+    }
+    
+    return processLoadedImage(original, thumbnail_size, sink, success);
+}
+
+uint64_t ImageProcessor::processEncodedImage(const unsigned char* encoded, size_t length,
+                                             const std::string& source_name,
+                                             int thumbnail_size,
+                                             const ThumbnailSink& sink,
+                                             bool& success) {
+    success = false;
+    
+    ImageData original = loadImageFromMemory(encoded, length, source_name);
+    if (!original.is_valid) {
+        return 0;
     }
     
+    return processLoadedImage(original, thumbnail_size, sink, success);
+}
+
+uint64_t ImageProcessor::processLoadedImage(ImageData& original,
+                                            int thumbnail_size,
+                                            const ThumbnailSink& sink,
+                                            bool& success) {
+    success = false;
+    
     // Calculate perceptual hash from original
-    hash = HashCalculator::calculatePerceptualHash(original.data, original.width, 
-                                                   original.height, original.channels);
+    uint64_t hash = HashCalculator::calculatePerceptualHash(original.data, original.width, 
+                                                            original.height, original.channels);
     
     // Create thumbnail
     ImageData thumbnail = createThumbnail(original, thumbnail_size);
@@ -113,8 +270,8 @@ uint64_t ImageProcessor::processSingleImage(const std::string& input_path,
         return hash;
     }
     
-    // Save thumbnail
-    success = saveThumbnail(thumbnail, output_path);
+    // Save, encode or place the thumbnail
+    success = sink(thumbnail);
     
     // Cleanup
     freeImage(original);
@@ -1,6 +1,8 @@
 #ifndef IMAGE_PROCESSOR_H
 #define IMAGE_PROCESSOR_H
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -16,9 +18,24 @@ public:
         ImageData() : data(nullptr), width(0), height(0), channels(0), is_valid(false) {}
     };
     
+    // Thumbnail encoded as JPEG in memory instead of written to a file
+    struct EncodedThumbnail {
+        std::vector<unsigned char> jpeg;
+        int width = 0;
+        int height = 0;
+    };
+    
+    // Receives the finished thumbnail (owned by the caller of the sink);
+    // returns whether it was stored successfully
+    using ThumbnailSink = std::function<bool(const ImageData& thumbnail)>;
+    
     // Load image from file
     static ImageData loadImage(const std::string& filepath);
     
+    // Decode image from an encoded file already in memory
+    static ImageData loadImageFromMemory(const unsigned char* encoded, size_t length,
+                                         const std::string& source_name);
+    
     // Free image data
     static void freeImage(ImageData& img);
     
@@ -26,19 +43,65 @@ public:
     static ImageData createThumbnail(const ImageData& original, int thumbnail_size);
     
     // Save thumbnail to file
-    static bool saveThumbnail(const ImageData& thumbnail, const std::string& output_path);
+    static bool saveThumbnail(const ImageData& thumbnail, const char* output_path);
+    
+    // Encode thumbnail as JPEG into out (replacing its contents)
+    static bool encodeThumbnail(const ImageData& thumbnail, EncodedThumbnail& out);
+    
+    // Encode thumbnail as JPEG straight into a caller buffer. size receives
+    // the full encoded size, which exceeds capacity if the buffer was too
+    // small (the output is then truncated).
+    static bool encodeThumbnail(const ImageData& thumbnail, unsigned char* out, size_t capacity, size_t& size);
     
     // Process single image: load, create thumbnail, save, return perceptual hash
     static uint64_t processSingleImage(const std::string& input_path,
-                                       const std::string& output_path,
+                                       const char* output_path,
+                                       int thumbnail_size,
+                                       bool& success);
+    
+    // Same as processSingleImage, decoding from an encoded file in memory
+    static uint64_t processEncodedImage(const unsigned char* encoded, size_t length,
+                                        const std::string& source_name,
+                                        const char* output_path,
+                                        int thumbnail_size,
+                                        bool& success);
+    
+    // Same as processSingleImage / processEncodedImage, encoding the
+    // thumbnail into memory
+    static uint64_t processSingleImage(const std::string& input_path,
                                        int thumbnail_size,
+                                       EncodedThumbnail& out,
                                        bool& success);
+    static uint64_t processEncodedImage(const unsigned char* encoded, size_t length,
+                                        const std::string& source_name,
+                                        int thumbnail_size,
+                                        EncodedThumbnail& out,
+                                        bool& success);
+    
+    // Same again, handing the raw thumbnail pixels to sink
+    static uint64_t processSingleImage(const std::string& input_path,
+                                       int thumbnail_size,
+                                       const ThumbnailSink& sink,
+                                       bool& success);
+    static uint64_t processEncodedImage(const unsigned char* encoded, size_t length,
+                                        const std::string& source_name,
+                                        int thumbnail_size,
+                                        const ThumbnailSink& sink,
+                                        bool& success);
     
     // Get file extension
     static std::string getFileExtension(const std::string& filepath);
     
     // Check if file is an image
     static bool isImageFile(const std::string& filepath);
+
+private:
+    // Hash and thumbnail an already decoded image, pass the thumbnail to
+    // sink and free both
+    static uint64_t processLoadedImage(ImageData& original,
+                                       int thumbnail_size,
+                                       const ThumbnailSink& sink,
+                                       bool& success);
 };
 
 #endif // IMAGE_PROCESSOR_H
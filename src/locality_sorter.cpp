@@ -0,0 +1,130 @@
+#include "locality_sorter.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+bool LocalitySorter::parseOrder(const std::string& name, InputOrder& order) {
+    if (name == "scan") {
+        order = InputOrder::Scan;
+    } else if (name == "inode") {
+        order = InputOrder::Inode;
+    } else if (name == "extent") {
+        order = InputOrder::Extent;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+LocalitySorter::PlacementKey LocalitySorter::readKey(const std::string& filepath, InputOrder order) {
+    PlacementKey key{0, 0, false};
+
+#ifndef _WIN32
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return key;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        key.device = st.st_dev;
+        key.position = st.st_ino;
+        key.valid = true;
+    }
+
+#ifdef __linux__
+    if (key.valid && order == InputOrder::Extent) {
+        // Only the first extent is needed: files are read front to back
+        alignas(struct fiemap) unsigned char request[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+        std::memset(request, 0, sizeof(request));
+        auto* map = reinterpret_cast<struct fiemap*>(request);
+        map->fm_start = 0;
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+
+        if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0) {
+            key.position = map->fm_extents[0].fe_physical;
+        }
+        // Otherwise (tmpfs, NFS, ...) fall back to the inode number
+    }
+#endif
+
+    close(fd);
+#else
+    (void)filepath;
+    (void)order;
+#endif
+
+    return key;
+}
+
+void LocalitySorter::sort(std::vector<std::string>& files, InputOrder order, TaskScheduler& scheduler,
+                          std::vector<int64_t>* sizes) {
+    if (order == InputOrder::Scan || files.size() < 2) {
+        return;
+    }
+
+    std::vector<PlacementKey> keys(files.size());
+    TaskGroup group;
+    scheduler.parallelFor(0, files.size(), 64, [&files, &keys, order](int64_t i) {
+        keys[i] = readKey(files[i], order);
+    }, TaskScheduler::Priority::Normal, group);
+    scheduler.wait(group);
+
+    std::vector<size_t> permutation(files.size());
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::stable_sort(permutation.begin(), permutation.end(), [&keys](size_t a, size_t b) {
+        const PlacementKey& ka = keys[a];
+        const PlacementKey& kb = keys[b];
+        if (ka.valid != kb.valid) {
+            return ka.valid;
+        }
+        if (ka.device != kb.device) {
+            return ka.device < kb.device;
+        }
+        return ka.position < kb.position;
+    });
+
+    std::vector<std::string> sorted;
+    sorted.reserve(files.size());
+    for (size_t index : permutation) {
+        sorted.push_back(std::move(files[index]));
+    }
+    files.swap(sorted);
+
+    if (sizes != nullptr) {
+        std::vector<int64_t> sorted_sizes;
+        sorted_sizes.reserve(sizes->size());
+        for (size_t index : permutation) {
+            sorted_sizes.push_back((*sizes)[index]);
+        }
+        sizes->swap(sorted_sizes);
+    }
+}
+
+void LocalitySorter::prefetch(const std::string& filepath) {
+#if defined(__linux__) || defined(POSIX_FADV_WILLNEED)
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // Starts asynchronous readahead of the whole file; the pages stay in
+    // the page cache after the descriptor is closed
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    (void)filepath;
+#endif
+}
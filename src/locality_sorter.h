@@ -0,0 +1,37 @@
+#ifndef LOCALITY_SORTER_H
+#define LOCALITY_SORTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "task_scheduler.h"
+
+// Orders a work list by physical placement so cold reads from spinning
+// disks become mostly sequential, and issues readahead hints in that order.
+class LocalitySorter {
+public:
+    // Parse "scan", "inode" or "extent"
+    static bool parseOrder(const std::string& name, InputOrder& order);
+
+    // Reorder files in place. Placement keys are gathered in parallel on
+    // the scheduler; files whose key cannot be read keep their relative
+    // order at the end of the list. sizes, if given, is reordered with files.
+    static void sort(std::vector<std::string>& files, InputOrder order, TaskScheduler& scheduler,
+                     std::vector<int64_t>* sizes = nullptr);
+
+    // Ask the kernel to start reading a file into the page cache (non-blocking)
+    static void prefetch(const std::string& filepath);
+
+private:
+    struct PlacementKey {
+        unsigned long long device;
+        unsigned long long position;
+        bool valid;
+    };
+
+    static PlacementKey readKey(const std::string& filepath, InputOrder order);
+};
+
+#endif // LOCALITY_SORTER_H
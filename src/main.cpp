@@ -2,52 +2,157 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <unordered_map>
 #include <omp.h>
 
+#include "config.h"
+#include "async_reader.h"
+#include "atlas_builder.h"
+#include "checkpoint_journal.h"
+#include "content_store.h"
+#include "directory_scanner.h"
+#include "exact_duplicate_finder.h"
+#include "external_duplicate_finder.h"
+#include "file_list_reader.h"
+#include "file_watcher.h"
 #include "image_processor.h"
+#include "locality_sorter.h"
+#include "output_linker.h"
 #include "hash_calculator.h"
+#include "hash_index.h"
 #include "duplicate_detector.h"
 #include "performance_tracker.h"
+#include "scratch_arena.h"
+#include "task_scheduler.h"
+#include "thumbnail_archive.h"
+#include "thumbnail_pipeline.h"
+
+#ifndef _WIN32
+#include "batch_worker.h"
+#include "coordinator_server.h"
+#include "daemon_server.h"
+#include "http_server.h"
+#endif
 
 namespace fs = std::filesystem;
 
-struct Config {
-    std::string input_dir;
-    std::string output_dir;
-    int thumbnail_size = 256;
-    int hamming_threshold = 8;
-    int num_threads = 0;  // 0 = use all available
-    bool run_serial = true;
-    bool run_parallel = true;
-    bool compare_modes = true;
-};
+// Entries parsed from a file list per step, and how many may be queued
+// ahead of the workers before the reader waits
+const size_t kListChunkSize = 4096;
+const int64_t kListMaxInFlight = 4 * kListChunkSize;
 
 void printUsage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [options]\n\n";
     std::cout << "Options:\n";
-    std::cout << "  -i <dir>     Input directory with images (required)\n";
+    std::cout << "  -i <dir>     Input directory with images (required unless -l is given)\n";
+    std::cout << "  -l <file>    Read image paths from a list instead of scanning (\"-\" = stdin);\n";
+    std::cout << "               newline- or NUL-separated, optional \"<path>\\t<size>\" records\n";
     std::cout << "  -o <dir>     Output directory for thumbnails (default: ./output/thumbnails)\n";
     std::cout << "  -s <size>    Thumbnail size in pixels (default: 256)\n";
     std::cout << "  -t <value>   Hamming distance threshold for duplicates (default: 8)\n";
     std::cout << "  -n <num>     Number of threads for parallel mode (default: all available)\n";
+    std::cout << "  --order <m>  Processing order: scan, inode or extent (physical placement, default: scan)\n";
+    std::cout << "  --prefetch <n>  Files to read ahead when --order is inode/extent (default: 32)\n";
+    std::cout << "  --reader <r> Input reader for parallel mode: direct, threads, uring or mmap (default: direct)\n";
+    std::cout << "  --queue-depth <n>  Reads kept in flight by the threads/uring reader (default: 32)\n";
+    std::cout << "  --skip-exact-dups  Hash before decoding and skip byte-identical images (parallel mode)\n";
+    std::cout << "  --dup-output <p>   Thumbnails of exact duplicates: none, hardlink, reflink or symlink\n";
+    std::cout << "                     (default: none; implies --skip-exact-dups)\n";
+    std::cout << "  --layout <l> Thumbnail layout: flat (<stem>_thumb.jpg), sharded (ab/cd/<hash>.jpg\n";
+    std::cout << "               plus index.tsv), archive (packed segments plus archive.idx) or\n";
+    std::cout << "               atlas (sprite sheets plus atlas.json); non-flat layouts imply\n";
+    std::cout << "               --skip-exact-dups (default: flat)\n";
+    std::cout << "  --atlas-size <px>  Atlas page width and maximum height (default: 4096)\n";
+    std::cout << "  --daemon <socket>  Serve FILES/IMAGE requests on a Unix socket, keeping workers\n";
+    std::cout << "                     and the duplicate index warm (flat or sharded layout)\n";
+    std::cout << "  --http <[host:]port>  Serve GET /thumb?path=<file>&size=<px> over HTTP from an\n";
+    std::cout << "                     in-memory cache (host defaults to 127.0.0.1; with -i, paths\n";
+    std::cout << "                     are resolved inside that directory)\n";
+    std::cout << "  --cache-mb <n>     Thumbnail cache size of the HTTP server (default: 256)\n";
+    std::cout << "  --watch      After processing -i, keep watching it and thumbnail only files that\n";
+    std::cout << "               are created, changed or moved in (Linux; flat or sharded layout)\n";
+    std::cout << "  --debounce <ms>  Quiet period before --watch processes changes (default: 500)\n";
+    std::cout << "  --hash-index <file>  Match images against the duplicate index saved in <file>\n";
+    std::cout << "                     (mapped, not loaded) and save it with this run merged in\n";
+    std::cout << "  --external-dups <dir>  Find duplicates out of core for corpora too large for memory,\n";
+    std::cout << "                     spilling sort runs to <dir>; writes <-o>/duplicates.tsv\n";
+    std::cout << "                     (implies --parallel)\n";
+    std::cout << "  --dup-memory-mb <n>  Memory for the --external-dups sorts (default: 1024)\n";
+    std::cout << "  --shard <i/N>  Process only shard i (0-based) of N, chosen by a hash of each path,\n";
+    std::cout << "                     and save its hashes to <-o>/hashes-<i>-of-<N>.hix for merge\n";
+    std::cout << "                     (with --layout sharded, merge --index-dir writes index.tsv)\n";
+    std::cout << "  --coordinator <[host:]port>  Hand the images of -i/-l out to --worker processes\n";
+    std::cout << "                     in leased batches over TCP, then find duplicates across all\n";
+    std::cout << "                     of them (flat or sharded layout)\n";
+    std::cout << "  --worker <host:port>  Thumbnail batches leased from a --coordinator into -o\n";
+    std::cout << "  --batch-size <n>  Images per --coordinator lease (default: 64)\n";
+    std::cout << "  --lease-sec <n>   Seconds before an unfinished lease is handed to another\n";
+    std::cout << "                     worker (default: 60)\n";
+    std::cout << "  --checkpoint <file>  Journal finished images to <file> as the parallel mode runs\n";
+    std::cout << "                     (flat or sharded layout; implies --parallel)\n";
+    std::cout << "  --resume     Only process the images not yet in the --checkpoint journal\n";
+    std::cout << "                     (default journal: <-o>/checkpoint.journal)\n";
     std::cout << "  --serial     Run only serial mode\n";
     std::cout << "  --parallel   Run only parallel mode\n";
     std::cout << "  -h, --help   Show this help message\n\n";
+    std::cout << "Archive lookup:\n";
+    std::cout << "  " << program_name << " archive <dir> [<source path|digest> [<output.jpg|->]]\n";
+    std::cout << "               Show archive size, locate a thumbnail, or extract it\n\n";
+    std::cout << "Similar images:\n";
+    std::cout << "  " << program_name << " similar <hash index> <image|hex phash> [-k <n>] [-r <distance>]\n";
+    std::cout << "               List the n nearest images in a --hash-index file (default: 10),\n";
+    std::cout << "               or all within distance, as \"<distance>\\t<path>\"\n\n";
+    std::cout << "Merging shards:\n";
+    std::cout << "  " << program_name << " merge [-t <n>] [-o <hash index>] [--external-dups <dir>\n";
+    std::cout << "               [--dup-memory-mb <n>]] [--index-dir <dir>] <partial.hix>...\n";
+    std::cout << "               Find duplicates across the partial hash files of --shard runs,\n";
+    std::cout << "               optionally saving them as one index (or out of core, writing\n";
+    std::cout << "               <dir>/duplicates.tsv); --index-dir writes the index.tsv of their\n";
+    std::cout << "               shared --layout sharded output directory\n\n";
     std::cout << "Example:\n";
     std::cout << "  " << program_name << " -i ./photos -o ./thumbnails -s 256 -t 8\n";
 }
 
+// Parse the value of option as a whole integer of at least minimum
+template <typename T>
+bool parseIntOption(const std::string& option, const std::string& value, T minimum, T& result) {
+    size_t length = 0;
+    long long parsed = 0;
+    try {
+        parsed = std::stoll(value, &length);
+    } catch (const std::exception&) {
+        length = 0;
+    }
+    if (length == 0 || length != value.size() || parsed < static_cast<long long>(minimum) || parsed > INT_MAX) {
+        std::cerr << "Invalid " << option << " (expected an integer >= " << minimum << "): " << value << std::endl;
+        return false;
+    }
+    result = static_cast<T>(parsed);
+    return true;
+}
+
 bool parseArguments(int argc, char* argv[], Config& config) {
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         
         if (arg == "-h" || arg == "--help") {
             printUsage(argv[0]);
+            config.help_requested = true;
             return false;
         }
         else if (arg == "-i" && i + 1 < argc) {
             config.input_dir = argv[++i];
         }
+        else if (arg == "-l" && i + 1 < argc) {
+            config.file_list = argv[++i];
+        }
         else if (arg == "-o" && i + 1 < argc) {
             config.output_dir = argv[++i];
         }
@@ -60,6 +165,139 @@ bool parseArguments(int argc, char* argv[], Config& config) {
         else if (arg == "-n" && i + 1 < argc) {
             config.num_threads = std::stoi(argv[++i]);
         }
+        else if (arg == "--order" && i + 1 < argc) {
+            if (!LocalitySorter::parseOrder(argv[++i], config.input_order)) {
+                std::cerr << "Unknown order: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--prefetch" && i + 1 < argc) {
+            if (!parseIntOption(arg, argv[++i], 1, config.prefetch_window)) {
+                return false;
+            }
+        }
+        else if (arg == "--reader" && i + 1 < argc) {
+            if (!AsyncReader::parseBackend(argv[++i], config.reader)) {
+                std::cerr << "Unknown reader: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--queue-depth" && i + 1 < argc) {
+            if (!parseIntOption(arg, argv[++i], 1, config.queue_depth)) {
+                return false;
+            }
+        }
+        else if (arg == "--skip-exact-dups") {
+            config.skip_exact_duplicates = true;
+        }
+        else if (arg == "--dup-output" && i + 1 < argc) {
+            if (!OutputLinker::parsePolicy(argv[++i], config.duplicate_output)) {
+                std::cerr << "Unknown duplicate output policy: " << argv[i] << std::endl;
+                return false;
+            }
+            if (config.duplicate_output != DuplicateOutput::None) {
+                config.skip_exact_duplicates = true;
+            }
+        }
+        else if (arg == "--layout" && i + 1 < argc) {
+            if (!ContentStore::parseLayout(argv[++i], config.layout)) {
+                std::cerr << "Unknown layout: " << argv[i] << std::endl;
+                return false;
+            }
+            if (config.layout != ThumbnailLayout::Flat) {
+                config.skip_exact_duplicates = true;
+            }
+        }
+        else if (arg == "--atlas-size" && i + 1 < argc) {
+            try {
+                config.atlas_size = std::stoi(argv[++i]);
+            } catch (const std::exception&) {
+                config.atlas_size = 0;
+            }
+            if (config.atlas_size <= 0) {
+                std::cerr << "Invalid atlas size: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--daemon" && i + 1 < argc) {
+            config.daemon_socket = argv[++i];
+        }
+        else if (arg == "--http" && i + 1 < argc) {
+            config.http_address = argv[++i];
+        }
+        else if (arg == "--cache-mb" && i + 1 < argc) {
+            size_t megabytes = 0;
+            if (!parseIntOption(arg, argv[++i], size_t(1), megabytes)) {
+                return false;
+            }
+            config.cache_bytes = megabytes * 1024 * 1024;
+        }
+        else if (arg == "--watch") {
+            config.watch = true;
+        }
+        else if (arg == "--debounce" && i + 1 < argc) {
+            if (!parseIntOption(arg, argv[++i], 0, config.watch_debounce_ms)) {
+                return false;
+            }
+        }
+        else if (arg == "--hash-index" && i + 1 < argc) {
+            config.hash_index = argv[++i];
+        }
+        else if (arg == "--external-dups" && i + 1 < argc) {
+            config.external_dups_dir = argv[++i];
+            config.run_serial = false;
+            config.run_parallel = true;
+            config.compare_modes = false;
+        }
+        else if (arg == "--dup-memory-mb" && i + 1 < argc) {
+            size_t megabytes = 0;
+            if (!parseIntOption(arg, argv[++i], size_t(1), megabytes)) {
+                return false;
+            }
+            config.external_memory_bytes = megabytes * 1024 * 1024;
+        }
+        else if (arg == "--shard" && i + 1 < argc) {
+            std::string shard = argv[++i];
+            size_t slash = shard.find('/');
+            try {
+                config.shard_index = std::stoi(shard.substr(0, slash));
+                config.shard_count = slash == std::string::npos ? 0 : std::stoi(shard.substr(slash + 1));
+            } catch (const std::exception&) {
+                config.shard_count = 0;
+            }
+            if (config.shard_count <= 0 || config.shard_index < 0 || config.shard_index >= config.shard_count) {
+                std::cerr << "Invalid shard (expected i/N with 0 <= i < N): " << shard << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--coordinator" && i + 1 < argc) {
+            config.coordinator_address = argv[++i];
+        }
+        else if (arg == "--worker" && i + 1 < argc) {
+            config.worker_address = argv[++i];
+        }
+        else if (arg == "--batch-size" && i + 1 < argc) {
+            if (!parseIntOption(arg, argv[++i], size_t(1), config.batch_size)) {
+                return false;
+            }
+        }
+        else if (arg == "--lease-sec" && i + 1 < argc) {
+            if (!parseIntOption(arg, argv[++i], 1, config.lease_seconds)) {
+                return false;
+            }
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc) {
+            config.checkpoint_path = argv[++i];
+            config.run_serial = false;
+            config.run_parallel = true;
+            config.compare_modes = false;
+        }
+        else if (arg == "--resume") {
+            config.resume = true;
+            config.run_serial = false;
+            config.run_parallel = true;
+            config.compare_modes = false;
+        }
         else if (arg == "--serial") {
             config.run_serial = true;
             config.run_parallel = false;
@@ -72,28 +310,98 @@ bool parseArguments(int argc, char* argv[], Config& config) {
         }
     }
     
-    return !config.input_dir.empty();
+    if (config.layout == ThumbnailLayout::Atlas && config.atlas_size < config.thumbnail_size) {
+        std::cerr << "--atlas-size (" << config.atlas_size << ") must be at least the thumbnail size ("
+                  << config.thumbnail_size << ")" << std::endl;
+        return false;
+    }
+    if (!config.external_dups_dir.empty() && !config.hash_index.empty()) {
+        std::cerr << "--external-dups cannot be combined with --hash-index" << std::endl;
+        return false;
+    }
+    if (config.shard_count > 0 && (!config.external_dups_dir.empty() || !config.hash_index.empty())) {
+        std::cerr << "--shard cannot be combined with --external-dups or --hash-index; "
+                  << "use them with merge" << std::endl;
+        return false;
+    }
+    
+    return !config.input_dir.empty() || !config.file_list.empty() ||
+           !config.daemon_socket.empty() || !config.http_address.empty() ||
+           !config.worker_address.empty();
 }
 
-std::vector<std::string> collectImageFiles(const std::string& directory) {
+// Read the whole file list, keeping only image files; sizes gets each
+// file's listed size, or -1 where the list does not give one
+std::vector<std::string> readImageList(const std::string& list_path, std::vector<int64_t>& sizes) {
     std::vector<std::string> image_files;
-    
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(directory)) {
-            if (entry.is_regular_file()) {
-                std::string filepath = entry.path().string();
-                if (ImageProcessor::isImageFile(filepath)) {
-                    image_files.push_back(filepath);
-                }
-            }
+    for (auto& entry : FileListReader::readAll(list_path)) {
+        if (ImageProcessor::isImageFile(entry.path)) {
+            image_files.push_back(std::move(entry.path));
+            sizes.push_back(entry.size);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
     }
+    return image_files;
+}
+
+int resolveThreadCount(const Config& config) {
+    // OMP_NUM_THREADS still sets the default
+    return config.num_threads > 0 ? config.num_threads : omp_get_max_threads();
+}
+
+std::vector<std::string> collectImageFiles(const std::string& directory, int num_threads) {
+    std::vector<std::string> image_files;
+    std::mutex image_files_mutex;
+    
+    TaskScheduler scheduler(num_threads);
+    TaskGroup scan_group;
+    DirectoryScanner::scan(scheduler, directory, [&](std::string filepath) {
+        std::lock_guard<std::mutex> lock(image_files_mutex);
+        image_files.push_back(std::move(filepath));
+    }, scan_group);
+    scheduler.wait(scan_group);
     
+    // Directories finish in any order; keep runs reproducible
+    std::sort(image_files.begin(), image_files.end());
     return image_files;
 }
 
+// Whether filepath belongs to this run's --shard. FNV-1a rather than
+// std::hash so that every host partitions the same list the same way.
+bool inShard(const Config& config, const std::string& filepath) {
+    if (config.shard_count <= 0) {
+        return true;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : filepath) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return static_cast<int>(hash % static_cast<uint64_t>(config.shard_count)) == config.shard_index;
+}
+
+std::string shardHashesPath(const Config& config) {
+    std::string name = "hashes-" + std::to_string(config.shard_index) + "-of-" +
+                       std::to_string(config.shard_count) + ".hix";
+    return (fs::path(config.output_dir) / name).string();
+}
+
+// Write index.tsv of the sharded layout. Shards share the output directory
+// but each sees only its own images, so merge --index-dir writes theirs.
+void writeContentIndex(const Config& config, const std::vector<std::pair<std::string, std::string>>& entries) {
+    if (config.shard_count == 0) {
+        ContentStore::writeIndex(config.output_dir, entries);
+    }
+}
+
+// Start from the saved duplicate index, if there is one yet
+void openHashIndex(const Config& config, DuplicateDetector& detector) {
+    if (config.hash_index.empty() || !fs::exists(config.hash_index)) {
+        return;
+    }
+    if (detector.open(config.hash_index)) {
+        std::cout << "Hash index: " << detector.size() << " images in " << config.hash_index << "\n";
+    }
+}
+
 void processImagesSerial(const std::vector<std::string>& image_files,
                         const Config& config,
                         PerformanceTracker& tracker,
@@ -104,30 +412,110 @@ void processImagesSerial(const std::vector<std::string>& image_files,
     tracker.setTotalImages(image_files.size());
     tracker.setThreadsUsed(1);
     detector.clear();
+    openHashIndex(config, detector);
     
     tracker.start();
     
-    for (const auto& filepath : image_files) {
-        // Generate output path
-        fs::path input_path(filepath);
-        std::string output_filename = input_path.stem().string() + "_thumb.jpg";
-        fs::path output_path = fs::path(config.output_dir) / output_filename;
+    uint64_t scratch_before = ScratchArena::getBlockAllocations();
+    
+    bool prefetch = config.input_order != InputOrder::Scan;
+    size_t prefetched = 0;
+    std::vector<std::pair<std::string, std::string>> index_entries;
+    
+    // Packed layouts store each content digest once
+    bool packed = config.layout == ThumbnailLayout::Archive || config.layout == ThumbnailLayout::Atlas;
+    ArchiveWriter archive;
+    AtlasBuilder atlas;
+    std::unordered_map<std::string, std::string> first_source;  // digest -> first source
+    ImageProcessor::EncodedThumbnail encoded;
+    if (config.layout == ThumbnailLayout::Archive) {
+        archive.open(config.output_dir);
+    } else if (config.layout == ThumbnailLayout::Atlas) {
+        atlas.open(config.output_dir, config.atlas_size);
+    }
+    
+    for (size_t i = 0; i < image_files.size(); i++) {
+        const std::string& filepath = image_files[i];
+        
+        // Keep readahead running a window ahead in placement order
+        while (prefetch && prefetched < image_files.size() &&
+               prefetched < i + static_cast<size_t>(config.prefetch_window)) {
+            LocalitySorter::prefetch(image_files[prefetched++]);
+        }
+        
+        // Per-image temporaries are released when the scope closes
+        ScratchArena::Scope scratch(ScratchArena::local());
+        
+        // Generate output path; the sharded layout needs the digest first
+        std::string md5;
+        ArenaString output_path;
+        if (packed) {
+            md5 = HashCalculator::calculateMD5(filepath);
+        } else if (config.layout == ThumbnailLayout::Sharded) {
+            md5 = HashCalculator::calculateMD5(filepath);
+            if (!md5.empty() && ContentStore::createShardDirectories(config.output_dir, md5)) {
+                output_path = ContentStore::buildPath(config.output_dir, md5);
+            }
+        } else {
+            output_path = ThumbnailPipeline::buildOutputPath(config.output_dir, filepath);
+        }
         
         // Process image
         bool success = false;
-        uint64_t phash = ImageProcessor::processSingleImage(
-            filepath, output_path.string(), config.thumbnail_size, success
-        );
+        uint64_t phash = 0;
+        if (packed && !md5.empty()) {
+            auto inserted = first_source.emplace(md5, filepath);
+            bool store = inserted.second;
+            if (!store) {
+                // Same bytes as an earlier image; the serial baseline still
+                // decodes it for the perceptual hash but stores nothing new
+                if (config.layout == ThumbnailLayout::Archive) {
+                    archive.addAlias(filepath, inserted.first->second);
+                } else {
+                    atlas.addAlias(filepath, inserted.first->second);
+                }
+            }
+            if (config.layout == ThumbnailLayout::Archive) {
+                phash = ImageProcessor::processSingleImage(filepath, config.thumbnail_size, encoded, success);
+                if (success && store) {
+                    success = archive.append(filepath, md5, encoded.jpeg.data(), encoded.jpeg.size(),
+                                             encoded.width, encoded.height);
+                }
+            } else {
+                phash = ImageProcessor::processSingleImage(filepath, config.thumbnail_size,
+                    [&](const ImageProcessor::ImageData& thumbnail) {
+                        return !store || atlas.add(filepath, thumbnail);
+                    }, success);
+            }
+        } else if (!output_path.empty()) {
+            phash = ImageProcessor::processSingleImage(
+                filepath, output_path.c_str(), config.thumbnail_size, success
+            );
+        }
         
         if (success) {
             tracker.incrementSuccess();
-            std::string md5 = HashCalculator::calculateMD5(filepath);
+            if (md5.empty()) {
+                md5 = HashCalculator::calculateMD5(filepath);
+            } else if (config.layout == ThumbnailLayout::Sharded) {
+                index_entries.emplace_back(filepath, md5);
+            }
             detector.addImageHash(filepath, md5, phash);
         } else {
             tracker.incrementFailure();
         }
     }
     
+    tracker.setArenaBlockAllocations(ScratchArena::getBlockAllocations() - scratch_before);
+    
+    if (config.layout == ThumbnailLayout::Sharded) {
+        writeContentIndex(config, index_entries);
+    } else if (config.layout == ThumbnailLayout::Archive) {
+        archive.finish();
+    } else if (config.layout == ThumbnailLayout::Atlas) {
+        atlas.finish();
+    }
+    
     // Find duplicates
     detector.findDuplicates();
     tracker.setDuplicatesFound(detector.getDuplicateCount());
@@ -136,13 +524,149 @@ void processImagesSerial(const std::vector<std::string>& image_files,
     tracker.printStatistics("SERIAL");
 }
 
-void processImagesParallel(const std::vector<std::string>& image_files,
+void printReaderInfo(const ThumbnailPipeline& pipeline, const Config& config) {
+    ReaderBackend backend = pipeline.getReaderBackend();
+    if (backend == ReaderBackend::Threads || backend == ReaderBackend::IoUring) {
+        std::cout << "Reader: " << AsyncReader::getBackendName(backend)
+                  << " (queue depth " << config.queue_depth << ")\n";
+    } else if (backend == ReaderBackend::Mmap) {
+        std::cout << "Reader: " << AsyncReader::getBackendName(backend) << "\n";
+    }
+}
+
+// Open the --external-dups spill files; null without --external-dups.
+// Results are spilled by the pipeline's completion listener as they finish
+// (see spillResult) instead of being collected, keeping memory bounded.
+std::unique_ptr<ExternalDuplicateFinder> openExternalSpill(const Config& config) {
+    if (config.external_dups_dir.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<ExternalDuplicateFinder> external(new ExternalDuplicateFinder(
+        config.external_dups_dir, config.external_memory_bytes, config.hamming_threshold));
+    if (!external->open()) {
+        return nullptr;
+    }
+    return external;
+}
+
+void spillResult(ExternalDuplicateFinder& external, const ThumbnailPipeline::ImageResult& result) {
+    // A failed write is sticky and fails recordResults via finish()
+    external.add(result.filepath, result.md5, result.phash);
+}
+
+// Feed pipeline results into the tracker, duplicate detector and output index
+// (and resumed, the images finished by an earlier run). With external, the
+// pipeline's results were already spilled to it. False if the out-of-core
+// search failed.
+bool recordResults(const ThumbnailPipeline& pipeline,
+                   const Config& config,
+                   PerformanceTracker& tracker,
+                   DuplicateDetector& detector,
+                   ExternalDuplicateFinder* external,
+                   const std::vector<ThumbnailPipeline::ImageResult>& resumed = {}) {
+    // Resumed images were finished outside the timed run
+    for (int i = 0; i < pipeline.getSuccessCount(); i++) {
+        tracker.incrementSuccess();
+    }
+    tracker.setResumedImages(static_cast<int>(resumed.size()));
+    for (int i = 0; i < pipeline.getFailureCount(); i++) {
+        tracker.incrementFailure();
+    }
+    tracker.setExactDuplicatesSkipped(pipeline.getSkippedCount());
+    if (pipeline.getLinkedCount() > 0) {
+        std::cout << "Linked " << pipeline.getLinkedCount() << " duplicate thumbnails\n";
+    }
+    
+    // Add hashes to the detector (or the spill) and the sharded layout's index
+    bool sharded = config.layout == ThumbnailLayout::Sharded;
+    std::vector<std::pair<std::string, std::string>> index_entries;
+    std::vector<ThumbnailPipeline::ImageResult> results;
+    if (!external || sharded) {
+        results = pipeline.collectResults();
+    }
+    auto record = [&](const ThumbnailPipeline::ImageResult& result, bool spilled) {
+        if (!result.success) return;
+        if (!external) {
+            detector.addImageHash(result.filepath, result.md5, result.phash);
+        } else if (!spilled) {
+            spillResult(*external, result);
+        }
+        if (sharded) {
+            index_entries.emplace_back(result.filepath, result.md5);
+        }
+    };
+    for (const auto& result : results) {
+        record(result, true);
+    }
+    for (const auto& result : resumed) {
+        record(result, false);
+    }
+    if (sharded) {
+        writeContentIndex(config, index_entries);
+    }
+    
+    // Find duplicates
+    if (external) {
+        std::string report_path = (fs::path(config.output_dir) / "duplicates.tsv").string();
+        ExternalDuplicateFinder::Summary summary;
+        if (!external->finish(report_path, summary)) {
+            return false;
+        }
+        std::cout << "Out-of-core duplicates: " << summary.exact_duplicates << " exact (in "
+                  << summary.exact_groups << " groups), " << summary.similar_pairs
+                  << " similar pairs, " << summary.sorted_runs << " sort runs; see " << report_path << "\n";
+        tracker.setDuplicatesFound(static_cast<int>(summary.exact_duplicates + summary.similar_pairs));
+        return true;
+    }
+    detector.findDuplicates();
+    tracker.setDuplicatesFound(detector.getDuplicateCount());
+    return true;
+}
+
+// Open the --checkpoint journal. With --resume, the images it already
+// holds become resumed and the rest go to remaining, with their positions
+// in image_files in remaining_index.
+bool startCheckpoint(const Config& config,
+                     const std::vector<std::string>& image_files,
+                     CheckpointJournal& journal,
+                     std::vector<ThumbnailPipeline::ImageResult>& resumed,
+                     std::vector<std::string>& remaining,
+                     std::vector<uint64_t>& remaining_index) {
+    std::vector<CheckpointJournal::Entry> entries;
+    bool append = config.resume && fs::exists(config.checkpoint_path);
+    if (append && !CheckpointJournal::replay(config.checkpoint_path, image_files, entries)) {
+        return false;
+    }
+    
+    std::vector<bool> finished(image_files.size(), false);
+    for (const auto& entry : entries) {
+        if (finished[entry.index]) continue;
+        finished[entry.index] = true;
+        resumed.push_back(ThumbnailPipeline::ImageResult{image_files[entry.index], HashIndex::unpackDigest(entry.digest),
+                                                         entry.phash, entry.index, -1, std::string(), true});
+    }
+    for (size_t i = 0; i < image_files.size(); i++) {
+        if (!finished[i]) {
+            remaining.push_back(image_files[i]);
+            remaining_index.push_back(i);
+        }
+    }
+    if (config.resume) {
+        std::cout << "Resuming: " << resumed.size() << " of " << image_files.size()
+                  << " images already done (" << config.checkpoint_path << ")\n";
+    }
+    return journal.open(config.checkpoint_path, image_files, append);
+}
+
+// image_sizes holds the sizes a -l list gave for image_files (-1 where
+// unknown), or is empty. False if the --checkpoint journal could not be used
+bool processImagesParallel(const std::vector<std::string>& image_files,
+                          const std::vector<int64_t>& image_sizes,
                           const Config& config,
                           PerformanceTracker& tracker,
                           DuplicateDetector& detector) {
-    // Set number of threads
-    int num_threads = config.num_threads > 0 ? config.num_threads : omp_get_max_threads();
-    omp_set_num_threads(num_threads);
+    int num_threads = resolveThreadCount(config);
+    TaskScheduler scheduler(num_threads);
     
     std::cout << "\n[PARALLEL MODE] Processing " << image_files.size() 
               << " images with " << num_threads << " threads...\n";
@@ -151,90 +675,617 @@ void processImagesParallel(const std::vector<std::string>& image_files,
     tracker.setTotalImages(image_files.size());
     tracker.setThreadsUsed(num_threads);
     detector.clear();
+    openHashIndex(config, detector);
+    
+    // With --checkpoint, images are journaled as they finish
+    CheckpointJournal journal;
+    std::vector<ThumbnailPipeline::ImageResult> resumed;
+    std::vector<std::string> remaining;
+    std::vector<uint64_t> remaining_index;
+    bool checkpoint = !config.checkpoint_path.empty();
+    if (checkpoint && !startCheckpoint(config, image_files, journal, resumed, remaining, remaining_index)) {
+        return false;
+    }
+    const std::vector<std::string>& work = checkpoint ? remaining : image_files;
+    if (!resumed.empty()) {
+        // Journals may hold images the size prefilter never hashed; exact
+        // duplicates between them and the remaining images need digests
+        TaskGroup hash_group;
+        scheduler.parallelFor(0, resumed.size(), 16, [&resumed](int64_t i) {
+            if (resumed[i].md5.empty()) {
+                resumed[i].md5 = HashCalculator::calculateMD5(resumed[i].filepath);
+            }
+        }, TaskScheduler::Priority::Normal, hash_group);
+        scheduler.wait(hash_group);
+    }
+    std::unique_ptr<ExternalDuplicateFinder> external = openExternalSpill(config);
+    if (!config.external_dups_dir.empty() && !external) {
+        return false;
+    }
+    
+    uint64_t scratch_before = ScratchArena::getBlockAllocations();
+    
+    tracker.start();
     
-    // Thread-local counters
-    std::vector<int> thread_success(num_threads, 0);
-    std::vector<int> thread_failure(num_threads, 0);
+    ThumbnailPipeline pipeline(config, scheduler);
+    printReaderInfo(pipeline, config);
+    if (checkpoint || external) {
+        pipeline.setKeepResults(!external);
+        pipeline.setCompletionListener([&](const ThumbnailPipeline::ImageResult& result) {
+            if (checkpoint) {
+                journal.add(remaining_index[result.order], result.md5, result.phash);
+            }
+            if (external) {
+                spillResult(*external, result);
+            }
+        });
+    }
+    if (config.skip_exact_duplicates && config.layout == ThumbnailLayout::Flat) {
+        // The whole list is known, so exact duplicates can be settled up
+        // front by size and partial hashes instead of hashing every file.
+        // Listed sizes make the size stage free; the rest are looked up.
+        std::vector<int64_t> work_sizes;
+        if (!image_sizes.empty()) {
+            if (checkpoint) {
+                for (uint64_t index : remaining_index) {
+                    work_sizes.push_back(image_sizes[index]);
+                }
+            } else {
+                work_sizes = image_sizes;
+            }
+        }
+        ExactDuplicateFinder::Result duplicates = ExactDuplicateFinder::find(work, work_sizes, scheduler);
+        std::cout << "Exact duplicates: " << duplicates.duplicate_count << " (hashed "
+                  << duplicates.bytes_read / 1024 << " of " << duplicates.total_bytes / 1024 << " KB)\n";
+        pipeline.setExactDuplicates(std::move(duplicates));
+        // Shard partials and the journal outlive this run's search: merge
+        // and --resume find exact duplicates across runs by digest
+        pipeline.setFullDigests(config.shard_count > 0 || checkpoint);
+    }
+    if (config.input_order != InputOrder::Scan) {
+        pipeline.submitInOrder(work, config.prefetch_window);
+    } else {
+        pipeline.submitAll(work);
+    }
+    pipeline.wait();
+    if (checkpoint && !journal.close()) {
+        std::cerr << "Checkpoint journal " << config.checkpoint_path
+                  << " is incomplete; --resume will redo the images missing from it" << std::endl;
+        return false;
+    }
+    
+    tracker.stop();
+    tracker.setArenaBlockAllocations(ScratchArena::getBlockAllocations() - scratch_before);
+    
+    if (!recordResults(pipeline, config, tracker, detector, external.get(), resumed)) {
+        return false;
+    }
+    
+    tracker.printStatistics("PARALLEL");
+    return true;
+}
+
+// Parallel mode without a separate collection phase: images are queued as
+// soon as they are found (directory scan) or parsed (file list), so
+// thumbnails are produced while the input is still being enumerated.
+// False if the --external-dups search failed.
+bool processImagesStreaming(const Config& config,
+                            PerformanceTracker& tracker,
+                            DuplicateDetector& detector) {
+    int num_threads = resolveThreadCount(config);
+    TaskScheduler scheduler(num_threads);
+    
+    const std::string& source = config.file_list.empty() ? config.input_dir : config.file_list;
+    std::cout << "\n[PARALLEL MODE] Streaming images from " << source
+              << " with " << num_threads << " threads...\n";
+    
+    tracker.reset();
+    tracker.setThreadsUsed(num_threads);
+    detector.clear();
+    openHashIndex(config, detector);
+    std::unique_ptr<ExternalDuplicateFinder> external = openExternalSpill(config);
+    if (!config.external_dups_dir.empty() && !external) {
+        return false;
+    }
     
-    // Store hashes temporarily (thread-safe collection)
-    std::vector<std::string> filepaths_vec(image_files.size());
-    std::vector<std::string> md5_vec(image_files.size());
-    std::vector<uint64_t> phash_vec(image_files.size());
-    std::vector<bool> success_vec(image_files.size());
+    uint64_t scratch_before = ScratchArena::getBlockAllocations();
     
     tracker.start();
     
-    #pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < static_cast<int>(image_files.size()); i++) {
-        int thread_id = omp_get_thread_num();
-        
-        const std::string& filepath = image_files[i];
+    ThumbnailPipeline pipeline(config, scheduler);
+    printReaderInfo(pipeline, config);
+    if (external) {
+        pipeline.setKeepResults(false);
+        pipeline.setCompletionListener([&external](const ThumbnailPipeline::ImageResult& result) {
+            spillResult(*external, result);
+        });
+    }
+    if (!config.file_list.empty()) {
+        // Parse the list chunk by chunk on this thread while workers process
+        FileListReader reader;
+        if (reader.open(config.file_list)) {
+            std::vector<FileListReader::Entry> chunk;
+            uint64_t order = 0;
+            while (reader.nextChunk(chunk, kListChunkSize)) {
+                for (auto& entry : chunk) {
+                    if (ImageProcessor::isImageFile(entry.path) && inShard(config, entry.path)) {
+                        pipeline.submit(std::move(entry.path), order++, entry.size);
+                    }
+                }
+                chunk.clear();
+                pipeline.waitForBacklog(kListMaxInFlight);
+            }
+        }
+    } else {
+        DirectoryScanner::scan(scheduler, config.input_dir, [&pipeline, &config](std::string filepath) {
+            if (inShard(config, filepath)) {
+                pipeline.submit(std::move(filepath));
+            }
+        }, pipeline.getGroup());
+    }
+    pipeline.wait();
+    
+    tracker.stop();
+    tracker.setArenaBlockAllocations(ScratchArena::getBlockAllocations() - scratch_before);
+    tracker.setTotalImages(pipeline.getSuccessCount() + pipeline.getFailureCount());
+    
+    if (!recordResults(pipeline, config, tracker, detector, external.get())) {
+        return false;
+    }
+    
+    tracker.printStatistics("PARALLEL");
+    return true;
+}
+
+// Thumbnail images that appeared or changed under --watch and match each
+// against the images already indexed; indexed maps paths to digests.
+// Returns the number of images that failed.
+int updateWatchedImages(const std::vector<std::string>& image_files,
+                        const Config& config,
+                        TaskScheduler& scheduler,
+                        DuplicateDetector& detector,
+                        std::map<std::string, std::string>& indexed,
+                        bool report_matches) {
+    ThumbnailPipeline pipeline(config, scheduler);
+    pipeline.submitAll(image_files);
+    pipeline.wait();
+    
+    std::vector<DuplicateDetector::Match> matches;
+    for (const auto& result : pipeline.collectResults()) {
+        if (!result.success) {
+            // A file rewritten into something unreadable loses its old entry
+            detector.removeImageHash(result.filepath);
+            indexed.erase(result.filepath);
+            continue;
+        }
+        detector.insert(result.filepath, result.md5, result.phash, &matches);
+        indexed[result.filepath] = result.md5;
+        if (report_matches) {
+            for (const auto& match : matches) {
+                std::cout << "Duplicate: " << result.filepath << " ~ " << detector.getFilepath(match.id) << "\n";
+            }
+        }
+    }
+    return pipeline.getFailureCount();
+}
+
+// Drop path (and with directory, everything below it) from the index
+size_t removeWatchedImages(const std::string& path, bool directory,
+                           DuplicateDetector& detector,
+                           std::map<std::string, std::string>& indexed) {
+    size_t removed = 0;
+    if (indexed.erase(path) > 0) {
+        detector.removeImageHash(path);
+        removed++;
+    }
+    if (directory) {
+        std::string prefix = path + "/";
+        auto it = indexed.lower_bound(prefix);
+        while (it != indexed.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+            detector.removeImageHash(it->first);
+            it = indexed.erase(it);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void writeWatchIndex(const Config& config, const std::map<std::string, std::string>& indexed) {
+    if (config.layout == ThumbnailLayout::Sharded) {
+        std::vector<std::pair<std::string, std::string>> entries(indexed.begin(), indexed.end());
+        ContentStore::writeIndex(config.output_dir, entries);
+    }
+}
+
+// --watch: process the input tree once, then keep thumbnails and the
+// duplicate index current by handling only the files that change
+int watchInputDirectory(const Config& config) {
+    // Watch before listing, so files created during the first pass are
+    // picked up by the first batch of changes
+    FileWatcher watcher;
+    std::vector<std::string> image_files;
+    if (!watcher.open(config.input_dir, config.output_dir, image_files)) {
+        return 1;
+    }
+    
+    int num_threads = resolveThreadCount(config);
+    TaskScheduler scheduler(num_threads);
+    DuplicateDetector detector(config.hamming_threshold);
+    std::map<std::string, std::string> indexed;
+    
+    std::cout << "\n[WATCH MODE] Processing " << image_files.size()
+              << " images with " << num_threads << " threads...\n";
+    int failed = updateWatchedImages(image_files, config, scheduler, detector, indexed, false);
+    writeWatchIndex(config, indexed);
+    std::cout << "Indexed " << indexed.size() << " images (" << failed << " failed)\n";
+    detector.findDuplicates();
+    detector.printDuplicateReport();
+    
+    std::cout << "\nWatching " << config.input_dir << " for changes (Ctrl+C to stop)...\n" << std::flush;
+    
+    std::vector<FileWatcher::Change> changes;
+    bool overflowed = false;
+    while (watcher.waitForChanges(changes, config.watch_debounce_ms, overflowed)) {
+        auto start = std::chrono::steady_clock::now();
         
-        // Generate output path
-        fs::path input_path(filepath);
-        std::string output_filename = input_path.stem().string() + "_thumb.jpg";
-        fs::path output_path = fs::path(config.output_dir) / output_filename;
+        size_t removed = 0;
+        if (overflowed) {
+            // Removals may have been lost with the dropped events
+            std::cout << "Watch queue overflowed, rescanning " << config.input_dir << "\n";
+            std::vector<std::string> missing;
+            for (const auto& entry : indexed) {
+                std::error_code ec;
+                if (!fs::exists(entry.first, ec)) {
+                    missing.push_back(entry.first);
+                }
+            }
+            for (const auto& path : missing) {
+                removed += removeWatchedImages(path, false, detector, indexed);
+            }
+        }
         
-        // Process image
-        bool success = false;
-        uint64_t phash = ImageProcessor::processSingleImage(
-            filepath, output_path.string(), config.thumbnail_size, success
-        );
+        std::vector<std::string> updated;
+        for (const auto& change : changes) {
+            std::error_code ec;
+            if (!change.removed && fs::is_regular_file(change.path, ec)) {
+                updated.push_back(change.path);
+            } else {
+                // Removed, or already gone again when the batch was taken
+                removed += removeWatchedImages(change.path, change.directory, detector, indexed);
+            }
+        }
         
-        filepaths_vec[i] = filepath;
-        success_vec[i] = success;
-        phash_vec[i] = phash;
+        failed = updateWatchedImages(updated, config, scheduler, detector, indexed, true);
+        writeWatchIndex(config, indexed);
         
-        if (success) {
-            thread_success[thread_id]++;
-            md5_vec[i] = HashCalculator::calculateMD5(filepath);
-        } else {
-            thread_failure[thread_id]++;
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "Updated " << updated.size() - static_cast<size_t>(failed) << " images, " << failed << " failed, "
+                  << removed << " removed in " << elapsed << " ms (" << indexed.size() << " indexed)\n"
+                  << std::flush;
+    }
+    return 1;
+}
+
+#ifndef _WIN32
+// --coordinator: workers do the thumbnailing, this process only hands out
+// the list and finds duplicates in the hashes they send back
+int runCoordinator(const Config& config) {
+    std::vector<std::string> image_files;
+    if (!config.file_list.empty()) {
+        std::cout << "Reading file list: " << config.file_list << std::endl;
+        std::vector<int64_t> sizes;  // Workers read the files themselves
+        image_files = readImageList(config.file_list, sizes);
+    } else {
+        std::cout << "Scanning directory: " << config.input_dir << std::endl;
+        image_files = collectImageFiles(config.input_dir, resolveThreadCount(config));
+    }
+    if (image_files.empty()) {
+        std::cerr << "No image files found" << std::endl;
+        return 1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    CoordinatorServer server(image_files, config.batch_size, config.lease_seconds);
+    if (!server.run(config.coordinator_address)) {
+        return 1;
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    DuplicateDetector detector(config.hamming_threshold);
+    openHashIndex(config, detector);
+    std::vector<std::pair<std::string, std::string>> index_entries;
+    size_t failed = 0;
+    for (const auto& result : server.collectResults()) {
+        if (!result.success) {
+            failed++;
+            continue;
         }
+        detector.insert(result.filepath, result.md5, result.phash);
+        index_entries.emplace_back(result.filepath, result.md5);
+    }
+    if (config.layout == ThumbnailLayout::Sharded) {
+        ContentStore::writeIndex(config.output_dir, index_entries);
     }
     
-    tracker.stop();
+    CoordinatorServer::Stats stats = server.getStats();
+    std::cout << "Processed " << image_files.size() << " images (" << failed << " failed) in " << elapsed
+              << " s: " << stats.leases << " leases to " << stats.workers << " worker connections, "
+              << stats.reissued << " re-issued\n";
     
-    // Aggregate results
-    int total_success = 0;
-    int total_failure = 0;
-    for (int i = 0; i < num_threads; i++) {
-        total_success += thread_success[i];
-        total_failure += thread_failure[i];
+    detector.findDuplicates();
+    detector.printDuplicateReport();
+    if (!config.hash_index.empty()) {
+        if (!detector.save(config.hash_index)) {
+            return 1;
+        }
+        std::cout << "Hash index: " << detector.size() << " images saved to " << config.hash_index << "\n";
+    }
+    return 0;
+}
+#endif
+
+// "archive <dir> [key [output]]": random access to a --layout archive output
+int runArchiveCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
     }
     
-    // Update tracker
-    for (int i = 0; i < total_success; i++) {
-        tracker.incrementSuccess();
+    ArchiveReader reader;
+    if (!reader.open(argv[2])) {
+        return 1;
     }
-    for (int i = 0; i < total_failure; i++) {
-        tracker.incrementFailure();
+    
+    if (argc < 4) {
+        std::cout << reader.getPathCount() << " paths, " << reader.getDigestCount() << " thumbnails\n";
+        return 0;
     }
     
-    // Add hashes to detector
-    for (size_t i = 0; i < image_files.size(); i++) {
-        if (success_vec[i]) {
-            detector.addImageHash(filepaths_vec[i], md5_vec[i], phash_vec[i]);
+    std::string key = argv[3];
+    ThumbnailArchive::Record record;
+    if (!reader.findByPath(key, record) && !reader.findByDigest(key, record)) {
+        std::cerr << "Not in archive: " << key << std::endl;
+        return 1;
+    }
+    
+    if (argc < 5) {
+        std::cout << "segment " << record.segment << " offset " << record.offset
+                  << " length " << record.length << " size " << record.width << "x" << record.height << "\n";
+        return 0;
+    }
+    
+    std::vector<unsigned char> jpeg;
+    if (!reader.read(record, jpeg)) {
+        std::cerr << "Failed to read thumbnail: " << key << std::endl;
+        return 1;
+    }
+    
+    std::string output = argv[4];
+    if (output == "-") {
+        std::cout.write(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+        return std::cout ? 0 : 1;
+    }
+    std::ofstream file(output, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+    if (!file) {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Perceptual hash of an image file, or a hash given as hex digits
+bool resolveQueryHash(const std::string& key, uint64_t& phash) {
+    std::error_code ec;
+    if (fs::is_regular_file(key, ec)) {
+        ImageProcessor::ImageData image = ImageProcessor::loadImage(key);
+        if (!image.is_valid) {
+            std::cerr << "Failed to decode " << key << std::endl;
+            return false;
         }
+        phash = HashCalculator::calculatePerceptualHash(image.data, image.width, image.height, image.channels);
+        ImageProcessor::freeImage(image);
+        return true;
     }
     
-    // Find duplicates
-    detector.findDuplicates();
-    tracker.setDuplicatesFound(detector.getDuplicateCount());
+    size_t length = 0;
+    try {
+        phash = std::stoull(key, &length, 16);
+    } catch (const std::exception&) {
+        length = 0;
+    }
+    if (length == 0 || length != key.size()) {
+        std::cerr << "Not an image or a hex hash: " << key << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int runSimilarCommand(int argc, char* argv[]) {
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return 1;
+    }
     
-    tracker.printStatistics("PARALLEL");
+    size_t k = 10;
+    int radius = -1;
+    for (int i = 4; i < argc; i += 2) {
+        std::string arg = argv[i];
+        bool valid = i + 1 < argc;
+        try {
+            if (valid && arg == "-k") {
+                int value = std::stoi(argv[i + 1]);
+                valid = value > 0;
+                k = static_cast<size_t>(value);
+            } else if (valid && arg == "-r") {
+                radius = std::stoi(argv[i + 1]);
+                valid = radius >= 0;
+            } else {
+                valid = false;
+            }
+        } catch (const std::exception&) {
+            valid = false;
+        }
+        if (!valid) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    DuplicateDetector index;
+    uint64_t phash;
+    if (!index.open(argv[2]) || !resolveQueryHash(argv[3], phash)) {
+        return 1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DuplicateDetector::Match> matches =
+        radius >= 0 ? index.findWithin(phash, radius) : index.findNearest(phash, k);
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    
+    for (const auto& match : matches) {
+        std::cout << match.distance << "\t" << index.getFilepath(match.id) << "\n";
+    }
+    std::cerr << matches.size() << " of " << index.size() << " images in " << elapsed << " ms\n";
+    return 0;
+}
+
+// "merge [options] <partial>...": global duplicate detection over the
+// hash files written by --shard runs
+int runMergeCommand(int argc, char* argv[]) {
+    int hamming_threshold = 8;
+    std::string output_index;
+    std::string external_dir;
+    std::string content_index_dir;
+    size_t memory_bytes = Config().external_memory_bytes;
+    std::vector<std::string> partials;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool valid = true;
+        try {
+            if (arg == "-t" && i + 1 < argc) {
+                hamming_threshold = std::stoi(argv[++i]);
+                valid = hamming_threshold >= 0;
+            } else if (arg == "-o" && i + 1 < argc) {
+                output_index = argv[++i];
+            } else if (arg == "--external-dups" && i + 1 < argc) {
+                external_dir = argv[++i];
+            } else if (arg == "--index-dir" && i + 1 < argc) {
+                content_index_dir = argv[++i];
+            } else if (arg == "--dup-memory-mb" && i + 1 < argc) {
+                int megabytes = std::stoi(argv[++i]);
+                valid = megabytes > 0;
+                memory_bytes = static_cast<size_t>(megabytes) * 1024 * 1024;
+            } else if (!arg.empty() && arg[0] != '-') {
+                partials.push_back(arg);
+            } else {
+                valid = false;
+            }
+        } catch (const std::exception&) {
+            valid = false;
+        }
+        if (!valid) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (partials.empty() || (!external_dir.empty() && !output_index.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    DuplicateDetector detector(hamming_threshold);
+    ExternalDuplicateFinder external(external_dir, memory_bytes, hamming_threshold);
+    if (!external_dir.empty() && !external.open()) {
+        return 1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::string, std::string>> index_entries;
+    for (const auto& partial : partials) {
+        HashIndexReader reader;
+        if (!reader.open(partial)) {
+            return 1;
+        }
+        for (HashIndexReader::ImageId id = 0; id < reader.size(); id++) {
+            std::string filepath(reader.getPath(id));
+            if (!content_index_dir.empty()) {
+                std::string md5 = reader.getMd5(id);
+                if (!md5.empty()) {
+                    index_entries.emplace_back(filepath, md5);
+                }
+            }
+            if (!external_dir.empty()) {
+                if (!external.add(filepath, reader.getMd5(id), reader.getPhash(id))) {
+                    return 1;
+                }
+            } else {
+                detector.insert(filepath, reader.getMd5(id), reader.getPhash(id));
+            }
+        }
+        std::cout << "Merged " << reader.size() << " images from " << partial << "\n";
+    }
+    if (!content_index_dir.empty()) {
+        std::sort(index_entries.begin(), index_entries.end());
+        if (!ContentStore::writeIndex(content_index_dir, index_entries)) {
+            return 1;
+        }
+        std::cout << "Sharded layout index: " << index_entries.size() << " images in "
+                  << content_index_dir << "\n";
+    }
+    
+    if (!external_dir.empty()) {
+        std::string report_path = (fs::path(external_dir) / "duplicates.tsv").string();
+        ExternalDuplicateFinder::Summary summary;
+        if (!external.finish(report_path, summary)) {
+            return 1;
+        }
+        std::cout << "Out-of-core duplicates: " << summary.exact_duplicates << " exact (in "
+                  << summary.exact_groups << " groups), " << summary.similar_pairs << " similar pairs of "
+                  << summary.images << " images; see " << report_path << "\n";
+    } else {
+        detector.findDuplicates();
+        detector.printDuplicateReport();
+        if (!output_index.empty()) {
+            if (!detector.save(output_index)) {
+                return 1;
+            }
+            std::cout << "Hash index: " << detector.size() << " images saved to " << output_index << "\n";
+        }
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "Merged " << partials.size() << " partial hash files in " << elapsed << " ms\n";
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "archive") {
+        return runArchiveCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "similar") {
+        return runSimilarCommand(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "merge") {
+        return runMergeCommand(argc, argv);
+    }
+    
     Config config;
     config.output_dir = "./output/thumbnails";
     
     if (!parseArguments(argc, argv, config)) {
-        if (config.input_dir.empty()) {
+        if (config.help_requested) {
+            return 0;
+        }
+        // Invalid arguments were already reported; a bare run gets the usage
+        if (config.input_dir.empty() && config.file_list.empty() &&
+            config.daemon_socket.empty() && config.http_address.empty() &&
+            config.worker_address.empty()) {
             printUsage(argv[0]);
-            return 1;
         }
-        return 0;
+        return 1;
     }
     
     // Create output directory
@@ -245,34 +1296,155 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    // Collect image files
-    std::cout << "Scanning directory: " << config.input_dir << std::endl;
-    auto image_files = collectImageFiles(config.input_dir);
+#ifndef _WIN32
+    if (!config.daemon_socket.empty()) {
+        // Archive and atlas outputs are only complete once finished, which
+        // a daemon never is
+        if (config.layout != ThumbnailLayout::Flat && config.layout != ThumbnailLayout::Sharded) {
+            std::cerr << "--daemon supports only the flat and sharded layouts" << std::endl;
+            return 1;
+        }
+        DaemonServer server(config, resolveThreadCount(config));
+        return server.run(config.daemon_socket) ? 0 : 1;
+    }
     
-    if (image_files.empty()) {
-        std::cerr << "No image files found in directory: " << config.input_dir << std::endl;
+    if (!config.http_address.empty()) {
+        HttpServer server(config, resolveThreadCount(config));
+        return server.run(config.http_address) ? 0 : 1;
+    }
+    
+    if (!config.worker_address.empty() || !config.coordinator_address.empty()) {
+        // Batches are written one at a time by independent processes
+        if (config.layout != ThumbnailLayout::Flat && config.layout != ThumbnailLayout::Sharded) {
+            std::cerr << "--coordinator and --worker support only the flat and sharded layouts" << std::endl;
+            return 1;
+        }
+    }
+    
+    if (!config.worker_address.empty()) {
+        BatchWorker worker(config, resolveThreadCount(config));
+        return worker.run(config.worker_address) ? 0 : 1;
+    }
+#else
+    if (!config.daemon_socket.empty() || !config.http_address.empty() ||
+        !config.coordinator_address.empty() || !config.worker_address.empty()) {
+        std::cerr << "--daemon, --http, --coordinator and --worker are not supported on this platform" << std::endl;
+        return 1;
+    }
+#endif
+    
+    if (config.file_list.empty() && !fs::is_directory(config.input_dir)) {
+        std::cerr << "Input directory not found: " << config.input_dir << std::endl;
         return 1;
     }
     
-    std::cout << "Found " << image_files.size() << " image files.\n";
     std::cout << "Thumbnail size: " << config.thumbnail_size << "px\n";
     std::cout << "Hamming threshold: " << config.hamming_threshold << "\n";
     
+#ifndef _WIN32
+    if (!config.coordinator_address.empty()) {
+        return runCoordinator(config);
+    }
+#endif
+    
+    if (config.resume && config.checkpoint_path.empty()) {
+        config.checkpoint_path = (fs::path(config.output_dir) / "checkpoint.journal").string();
+    }
+    if (!config.checkpoint_path.empty() &&
+        config.layout != ThumbnailLayout::Flat && config.layout != ThumbnailLayout::Sharded) {
+        // Packed outputs are only complete once the whole run finishes
+        std::cerr << "--checkpoint supports only the flat and sharded layouts" << std::endl;
+        return 1;
+    }
+    
+    if (config.watch) {
+        if (config.input_dir.empty()) {
+            std::cerr << "--watch needs an input directory (-i)" << std::endl;
+            return 1;
+        }
+        if (config.layout != ThumbnailLayout::Flat && config.layout != ThumbnailLayout::Sharded) {
+            std::cerr << "--watch supports only the flat and sharded layouts" << std::endl;
+            return 1;
+        }
+        return watchInputDirectory(config);
+    }
+    
     // Performance trackers and duplicate detectors
     PerformanceTracker serial_tracker, parallel_tracker;
     DuplicateDetector serial_detector(config.hamming_threshold);
     DuplicateDetector parallel_detector(config.hamming_threshold);
     
-    // Run serial mode
-    if (config.run_serial) {
-        processImagesSerial(image_files, config, serial_tracker, serial_detector);
-        serial_detector.printDuplicateReport();
-    }
-    
-    // Run parallel mode
-    if (config.run_parallel) {
-        processImagesParallel(image_files, config, parallel_tracker, parallel_detector);
-        parallel_detector.printDuplicateReport();
+    if (!config.run_serial && config.input_order == InputOrder::Scan && config.checkpoint_path.empty()) {
+        // Parallel only: overlap scanning with processing
+        if (!processImagesStreaming(config, parallel_tracker, parallel_detector)) {
+            return 1;
+        }
+        if (parallel_tracker.getStatistics().total_images == 0) {
+            std::cerr << "No image files found" << std::endl;
+            return 1;
+        }
+        if (config.external_dups_dir.empty()) {
+            parallel_detector.printDuplicateReport();
+        }
+    } else {
+        // Collect image files, with their sizes if the list gives them
+        std::vector<std::string> image_files;
+        std::vector<int64_t> image_sizes;
+        if (!config.file_list.empty()) {
+            std::cout << "Reading file list: " << config.file_list << std::endl;
+            image_files = readImageList(config.file_list, image_sizes);
+        } else {
+            std::cout << "Scanning directory: " << config.input_dir << std::endl;
+            image_files = collectImageFiles(config.input_dir, resolveThreadCount(config));
+        }
+        if (config.shard_count > 0) {
+            size_t listed = image_files.size();
+            size_t kept = 0;
+            for (size_t i = 0; i < listed; i++) {
+                if (inShard(config, image_files[i])) {
+                    image_files[kept] = std::move(image_files[i]);
+                    if (!image_sizes.empty()) {
+                        image_sizes[kept] = image_sizes[i];
+                    }
+                    kept++;
+                }
+            }
+            image_files.resize(kept);
+            if (!image_sizes.empty()) {
+                image_sizes.resize(kept);
+            }
+            std::cout << "Shard " << config.shard_index << "/" << config.shard_count << ": "
+                      << image_files.size() << " of " << listed << " images\n";
+        }
+        
+        if (image_files.empty()) {
+            std::cerr << "No image files found" << std::endl;
+            return 1;
+        }
+        
+        if (config.input_order != InputOrder::Scan) {
+            TaskScheduler scheduler(resolveThreadCount(config));
+            LocalitySorter::sort(image_files, config.input_order, scheduler,
+                                 image_sizes.empty() ? nullptr : &image_sizes);
+        }
+        
+        std::cout << "Found " << image_files.size() << " image files.\n";
+        
+        // Run serial mode
+        if (config.run_serial) {
+            processImagesSerial(image_files, config, serial_tracker, serial_detector);
+            serial_detector.printDuplicateReport();
+        }
+        
+        // Run parallel mode
+        if (config.run_parallel) {
+            if (!processImagesParallel(image_files, image_sizes, config, parallel_tracker, parallel_detector)) {
+                return 1;
+            }
+            if (config.external_dups_dir.empty()) {
+                parallel_detector.printDuplicateReport();
+            }
+        }
     }
     
     // Compare modes
@@ -282,6 +1454,24 @@ int main(int argc, char* argv[]) {
         PerformanceTracker::printComparison(serial_stats, parallel_stats);
     }
     
+    if (!config.hash_index.empty()) {
+        DuplicateDetector& merged = config.run_parallel ? parallel_detector : serial_detector;
+        if (!merged.save(config.hash_index)) {
+            return 1;
+        }
+        std::cout << "Hash index: " << merged.size() << " images saved to " << config.hash_index << "\n";
+    }
+    
+    if (config.shard_count > 0) {
+        // Duplicates across shards are found by merge
+        DuplicateDetector& partial = config.run_parallel ? parallel_detector : serial_detector;
+        std::string partial_path = shardHashesPath(config);
+        if (!partial.save(partial_path)) {
+            return 1;
+        }
+        std::cout << "Shard hashes: " << partial.size() << " images saved to " << partial_path << "\n";
+    }
+    
     std::cout << "\nProcessing complete!\n";
     std::cout << "Thumbnails saved to: " << config.output_dir << "\n";
     
@@ -0,0 +1,73 @@
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : mapping(nullptr), length(0) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& filepath, Access access) {
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    // Fault the whole file in with one call instead of page by page
+    if (access == Access::Sequential) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, flags, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+    mapping = ptr;
+    length = static_cast<size_t>(st.st_size);
+    madvise(mapping, length, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return true;
+#else
+    (void)filepath;
+    (void)access;
+    return false;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (mapping != nullptr) {
+        madvise(mapping, length, MADV_DONTNEED);
+        munmap(mapping, length);
+    }
+#endif
+    mapping = nullptr;
+    length = 0;
+}
+
+const unsigned char* MappedFile::data() const {
+    return static_cast<const unsigned char*>(mapping);
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole input file. By default the mapping is
+// populated up front and marked sequential, so decoding and hashing work on the page
+// cache directly without copying the file into a user buffer. Closing the
+// mapping drops its pages from this process (MADV_DONTNEED) before unmapping.
+class MappedFile {
+public:
+    enum class Access {
+        Sequential,  // Read front to back once (input images)
+        Random,      // Probed at random, e.g. binary search over an index
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map filepath; returns false if it cannot be opened, is empty or
+    // mapping is not supported on this platform
+    bool open(const std::string& filepath, Access access = Access::Sequential);
+    void close();
+
+    const unsigned char* data() const;
+    size_t size() const;
+
+private:
+    void* mapping;
+    size_t length;
+};
+
+#endif // MAPPED_FILE_H
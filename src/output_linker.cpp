@@ -0,0 +1,98 @@
+#include "output_linker.h"
+#include <filesystem>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace fs = std::filesystem;
+
+bool OutputLinker::parsePolicy(const std::string& name, DuplicateOutput& policy) {
+    if (name == "none") {
+        policy = DuplicateOutput::None;
+    } else if (name == "hardlink") {
+        policy = DuplicateOutput::Hardlink;
+    } else if (name == "reflink") {
+        policy = DuplicateOutput::Reflink;
+    } else if (name == "symlink") {
+        policy = DuplicateOutput::Symlink;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool OutputLinker::link(const std::string& target, const std::string& link_path, DuplicateOutput policy) {
+    if (policy == DuplicateOutput::None || target == link_path) {
+        return true;
+    }
+
+    std::error_code ec;
+    fs::remove(link_path, ec);
+
+    switch (policy) {
+        case DuplicateOutput::Hardlink:
+            fs::create_hard_link(target, link_path, ec);
+            break;
+        case DuplicateOutput::Symlink: {
+            fs::path target_path(target);
+            fs::path link(link_path);
+            if (target_path.parent_path() == link.parent_path()) {
+                target_path = target_path.filename();
+            } else {
+                target_path = fs::absolute(target_path, ec);
+            }
+            if (!ec) {
+                fs::create_symlink(target_path, link_path, ec);
+            }
+            break;
+        }
+        case DuplicateOutput::Reflink:
+            if (!reflink(target, link_path)) {
+                fs::copy_file(target, link_path, fs::copy_options::overwrite_existing, ec);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (ec) {
+        std::cerr << "Failed to link thumbnail " << link_path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool OutputLinker::reflink(const std::string& target, const std::string& link_path) {
+#if defined(__linux__) && defined(FICLONE)
+    int source_fd = open(target.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        return false;
+    }
+    int dest_fd = open(link_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dest_fd < 0) {
+        close(source_fd);
+        return false;
+    }
+
+    bool cloned = ioctl(dest_fd, FICLONE, source_fd) == 0;
+    close(dest_fd);
+    close(source_fd);
+    if (!cloned) {
+        // EOPNOTSUPP / EXDEV: the caller copies instead
+        unlink(link_path.c_str());
+    }
+    return cloned;
+#else
+    (void)target;
+    (void)link_path;
+    return false;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef OUTPUT_LINKER_H
+#define OUTPUT_LINKER_H
+
+#include <string>
+
+#include "config.h"
+
+// Creates the thumbnail of an exact duplicate as a link to the thumbnail
+// already written for the original, instead of encoding the same JPEG again.
+class OutputLinker {
+public:
+    // Parse "none", "hardlink", "reflink" or "symlink"
+    static bool parsePolicy(const std::string& name, DuplicateOutput& policy);
+
+    // Make link_path refer to the contents of target, replacing any file
+    // already there. Reflinks fall back to a plain copy where the file
+    // system cannot share extents; symlinks are relative when both paths
+    // are in the same directory.
+    static bool link(const std::string& target, const std::string& link_path, DuplicateOutput policy);
+
+private:
+    static bool reflink(const std::string& target, const std::string& link_path);
+};
+
+#endif // OUTPUT_LINKER_H
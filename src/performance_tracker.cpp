@@ -5,7 +5,8 @@
 
 PerformanceTracker::PerformanceTracker() 
     : is_running(false), total_images(0), successful_images(0), 
-      failed_images(0), duplicates_found(0), threads_used(1) {
+      failed_images(0), duplicates_found(0), threads_used(1),
+      arena_block_allocations(0), exact_duplicates_skipped(0), resumed_images(0) {
 }
 
 void PerformanceTracker::start() {
@@ -25,6 +26,9 @@ void PerformanceTracker::reset() {
     failed_images = 0;
     duplicates_found = 0;
     threads_used = 1;
+    arena_block_allocations = 0;
+    exact_duplicates_skipped = 0;
+    resumed_images = 0;
 }
 
 void PerformanceTracker::incrementSuccess() {
@@ -47,6 +51,18 @@ void PerformanceTracker::setTotalImages(int count) {
     total_images = count;
 }
 
+void PerformanceTracker::setArenaBlockAllocations(uint64_t count) {
+    arena_block_allocations = count;
+}
+
+void PerformanceTracker::setExactDuplicatesSkipped(int count) {
+    exact_duplicates_skipped = count;
+}
+
+void PerformanceTracker::setResumedImages(int count) {
+    resumed_images = count;
+}
+
 double PerformanceTracker::getElapsedMilliseconds() const {
     auto end = is_running ? std::chrono::high_resolution_clock::now() : end_time;
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start_time);
@@ -61,6 +77,9 @@ PerformanceTracker::Statistics PerformanceTracker::getStatistics() const {
     stats.failed_images = failed_images;
     stats.duplicates_found = duplicates_found;
     stats.threads_used = threads_used;
+    stats.arena_block_allocations = arena_block_allocations;
+    stats.exact_duplicates_skipped = exact_duplicates_skipped;
+    stats.resumed_images = resumed_images;
     
     double total_time_sec = stats.total_time_ms / 1000.0;
     stats.images_per_second = (total_time_sec > 0) ? (successful_images / total_time_sec) : 0;
@@ -88,6 +107,11 @@ void PerformanceTracker::printStatistics(const std::string& mode_name) const {
     std::cout << "Threads Used:        " << stats.threads_used << "\n";
     std::cout << "Throughput:          " << stats.images_per_second << " images/sec\n";
     std::cout << "Avg Time/Image:      " << stats.avg_time_per_image_ms << " ms\n";
+    std::cout << "Arena Block Allocs:  " << stats.arena_block_allocations << "\n";
+    std::cout << "Exact Dups Skipped:  " << stats.exact_duplicates_skipped << "\n";
+    if (stats.resumed_images > 0) {
+        std::cout << "Resumed (untimed):   " << stats.resumed_images << "\n";
+    }
     std::cout << "========================================\n";
 }
 
@@ -2,6 +2,7 @@
 #define PERFORMANCE_TRACKER_H
 
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -18,6 +19,9 @@ public:
         double avg_time_per_image_ms;
         double speedup;
         double efficiency;
+        uint64_t arena_block_allocations;  // Blocks the scratch arenas grew by (not other heap use)
+        int exact_duplicates_skipped;  // Images not decoded because their bytes were seen before
+        int resumed_images;  // Finished by an earlier run (--resume); not in the timings
     };
 
     PerformanceTracker();
@@ -31,6 +35,9 @@ public:
     void setDuplicatesFound(int count);
     void setThreadsUsed(int count);
     void setTotalImages(int count);
+    void setArenaBlockAllocations(uint64_t count);
+    void setExactDuplicatesSkipped(int count);
+    void setResumedImages(int count);
     
     double getElapsedMilliseconds() const;
     Statistics getStatistics() const;
@@ -50,6 +57,9 @@ private:
     int failed_images;
     int duplicates_found;
     int threads_used;
+    uint64_t arena_block_allocations;
+    int exact_duplicates_skipped;
+    int resumed_images;
 };
 
 #endif // PERFORMANCE_TRACKER_H
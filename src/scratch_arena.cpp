@@ -0,0 +1,95 @@
+#include "scratch_arena.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> block_allocations(0);
+
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+ScratchArena::ScratchArena(size_t initial_capacity)
+    : current_block(0), offset(0) {
+    blocks.reserve(8);
+    addBlock(initial_capacity);
+}
+
+ScratchArena::~ScratchArena() {
+    for (auto& block : blocks) {
+        ::operator delete(block.data);
+    }
+}
+
+void ScratchArena::addBlock(size_t min_size) {
+    size_t size = blocks.empty() ? min_size : std::max(min_size, blocks.back().size * 2);
+
+    Block block;
+    block.data = static_cast<unsigned char*>(::operator new(size));
+    block.size = size;
+    blocks.push_back(block);
+    block_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void* ScratchArena::allocate(size_t bytes, size_t alignment) {
+    size_t start = alignUp(offset, alignment);
+
+    while (start + bytes > blocks[current_block].size) {
+        if (current_block + 1 < blocks.size() &&
+            bytes + alignment <= blocks[current_block + 1].size) {
+            // Reuse a block retained from before the last rewind
+            current_block++;
+        } else {
+            // Drop retained blocks that are too small and grow
+            for (size_t i = current_block + 1; i < blocks.size(); i++) {
+                ::operator delete(blocks[i].data);
+            }
+            blocks.resize(current_block + 1);
+            addBlock(bytes + alignment);
+            current_block++;
+        }
+        offset = 0;
+        start = alignUp(reinterpret_cast<uintptr_t>(blocks[current_block].data), alignment)
+                - reinterpret_cast<uintptr_t>(blocks[current_block].data);
+    }
+
+    offset = start + bytes;
+    return blocks[current_block].data + start;
+}
+
+ScratchArena::Marker ScratchArena::mark() const {
+    return Marker{current_block, offset};
+}
+
+void ScratchArena::rewind(const Marker& marker) {
+    current_block = marker.block;
+    offset = marker.offset;
+
+    if (current_block == 0 && offset == 0 && blocks.size() > 1) {
+        size_t total = getCapacity();
+        for (auto& block : blocks) {
+            ::operator delete(block.data);
+        }
+        blocks.clear();
+        addBlock(total);
+    }
+}
+
+size_t ScratchArena::getCapacity() const {
+    size_t total = 0;
+    for (const auto& block : blocks) {
+        total += block.size;
+    }
+    return total;
+}
+
+ScratchArena& ScratchArena::local() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+uint64_t ScratchArena::getBlockAllocations() {
+    return block_allocations.load(std::memory_order_relaxed);
+}
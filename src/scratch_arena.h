@@ -0,0 +1,108 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-thread bump allocator for per-image temporaries.
+// Allocations are handed out linearly and released all at once by
+// rewinding to a marker; individual deallocation is a no-op.
+class ScratchArena {
+public:
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    // Rewinds the arena to the state it had when the scope was opened
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena) : arena(arena), marker(arena.mark()) {}
+        ~Scope() { arena.rewind(marker); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ScratchArena& arena;
+        Marker marker;
+    };
+
+    explicit ScratchArena(size_t initial_capacity = 1 << 20);
+    ~ScratchArena();
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // Allocate bytes from the current block, growing if needed
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    Marker mark() const;
+
+    // Release everything allocated after the marker. Rewinding to an empty
+    // arena also coalesces all blocks into one, so the steady state is a
+    // single block that never touches the global allocator.
+    void rewind(const Marker& marker);
+
+    // Total bytes reserved from the global allocator
+    size_t getCapacity() const;
+
+    // Arena owned by the calling thread
+    static ScratchArena& local();
+
+    // Number of blocks requested from the global allocator by all arenas.
+    // Only arena growth: heap allocations made outside the arenas (by the
+    // decoder, encoder or containers) are not counted.
+    static uint64_t getBlockAllocations();
+
+private:
+    struct Block {
+        unsigned char* data;
+        size_t size;
+    };
+
+    void addBlock(size_t min_size);
+
+    std::vector<Block> blocks;
+    size_t current_block;
+    size_t offset;
+};
+
+// Minimal allocator adaptor so standard containers can live in an arena
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() : arena(&ScratchArena::local()) {}
+    explicit ArenaAllocator(ScratchArena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.getArena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    ScratchArena* getArena() const { return arena; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.getArena(); }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.getArena(); }
+
+private:
+    ScratchArena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+#endif // SCRATCH_ARENA_H
@@ -0,0 +1,181 @@
+#include "socket_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // Split "[host:]port"; "[::1]:8080" gives host "::1"
+    void splitAddress(const std::string& address, std::string& host, std::string& port) {
+        host = "127.0.0.1";
+        port = address;
+        size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2);
+        }
+    }
+
+    addrinfo* resolve(const std::string& address, bool passive, bool quiet) {
+        std::string host, port;
+        splitAddress(address, host, port);
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = (passive ? AI_PASSIVE : 0) | AI_NUMERICSERV;
+        addrinfo* addresses = nullptr;
+        int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if (error != 0) {
+            if (!quiet) {
+                std::cerr << "Invalid address " << address << ": " << gai_strerror(error) << std::endl;
+            }
+            return nullptr;
+        }
+        return addresses;
+    }
+}
+
+SocketStream::SocketStream(int fd, size_t max_line_length)
+    : fd(fd), max_line_length(max_line_length), consumed(0) {
+}
+
+bool SocketStream::readLine(std::string& line) {
+    while (true) {
+        size_t newline = buffer.find('\n', consumed);
+        if (newline != std::string::npos) {
+            size_t end = newline;
+            if (end > consumed && buffer[end - 1] == '\r') {
+                end--;
+            }
+            line.assign(buffer, consumed, end - consumed);
+            consumed = newline + 1;
+            return true;
+        }
+        if (buffer.size() - consumed > max_line_length || !fill()) {
+            return false;
+        }
+    }
+}
+
+bool SocketStream::readBytes(std::vector<unsigned char>& out, size_t length) {
+    out.clear();
+    out.reserve(length);
+    while (out.size() < length) {
+        if (consumed == buffer.size() && !fill()) {
+            return false;
+        }
+        size_t take = std::min(length - out.size(), buffer.size() - consumed);
+        out.insert(out.end(), buffer.begin() + consumed, buffer.begin() + consumed + take);
+        consumed += take;
+    }
+    return true;
+}
+
+bool SocketStream::skipBytes(size_t length) {
+    while (length > 0) {
+        if (consumed == buffer.size() && !fill()) {
+            return false;
+        }
+        size_t take = std::min(length, buffer.size() - consumed);
+        consumed += take;
+        length -= take;
+    }
+    return true;
+}
+
+bool SocketStream::write(const void* data, size_t length) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool SocketStream::write(const std::string& text) {
+    return write(text.data(), text.size());
+}
+
+bool SocketStream::fill() {
+    // Drop what was consumed before growing the buffer
+    buffer.erase(0, consumed);
+    consumed = 0;
+
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(received));
+        return true;
+    }
+}
+
+int listenTcp(const std::string& address) {
+    addrinfo* addresses = resolve(address, true, false);
+    if (addresses == nullptr) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* candidate = addresses; candidate != nullptr && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd < 0) continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) != 0 || listen(fd, 128) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        std::cerr << "Cannot listen on " << address << ": " << std::strerror(errno) << std::endl;
+    }
+    return fd;
+}
+
+int connectTcp(const std::string& address, bool quiet) {
+    addrinfo* addresses = resolve(address, false, quiet);
+    if (addresses == nullptr) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* candidate = addresses; candidate != nullptr && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        if (!quiet) {
+            std::cerr << "Cannot connect to " << address << ": " << std::strerror(errno) << std::endl;
+        }
+        return -1;
+    }
+    // Requests and replies are written whole; do not hold them back
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
@@ -0,0 +1,43 @@
+#ifndef SOCKET_STREAM_H
+#define SOCKET_STREAM_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Buffered line and payload reader over a connected socket, shared by the
+// daemon and HTTP front ends. Does not own the descriptor.
+class SocketStream {
+public:
+    explicit SocketStream(int fd, size_t max_line_length = 64 * 1024);
+
+    // Next line without its newline (or CRLF); false on EOF, error or a
+    // line longer than max_line_length
+    bool readLine(std::string& line);
+
+    // Exactly length bytes into out (replacing its contents)
+    bool readBytes(std::vector<unsigned char>& out, size_t length);
+
+    // Read and drop length bytes
+    bool skipBytes(size_t length);
+
+    bool write(const void* data, size_t length);
+    bool write(const std::string& text);
+
+private:
+    bool fill();
+
+    int fd;
+    size_t max_line_length;
+    std::string buffer;
+    size_t consumed;
+};
+
+// Listening TCP socket on "[host:]port" (host defaults to 127.0.0.1; IPv6
+// hosts in brackets); -1 on failure, reported on std::cerr
+int listenTcp(const std::string& address);
+
+// TCP connection to "host:port"; -1 on failure (reported unless quiet)
+int connectTcp(const std::string& address, bool quiet = false);
+
+#endif // SOCKET_STREAM_H
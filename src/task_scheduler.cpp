@@ -0,0 +1,315 @@
+#include "task_scheduler.h"
+#include <exception>
+#include <iostream>
+
+namespace {
+    thread_local const TaskScheduler* current_scheduler = nullptr;
+    thread_local int current_worker = -1;
+
+    const int kSpinRounds = 64;
+}
+
+// ---------------------------------------------------------------------------
+// Chase-Lev deque (memory orderings after Le et al., PPoPP 2013)
+// ---------------------------------------------------------------------------
+
+TaskScheduler::WorkStealingDeque::Ring::Ring(int64_t capacity)
+    : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {
+}
+
+TaskScheduler::WorkStealingDeque::WorkStealingDeque() : top(0), bottom(0) {
+    rings.emplace_back(new Ring(256));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+TaskScheduler::WorkStealingDeque::~WorkStealingDeque() {
+    // Tasks left behind only exist if the scheduler was torn down early
+    int64_t t = top.load(std::memory_order_relaxed);
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    Ring* r = ring.load(std::memory_order_relaxed);
+    for (int64_t i = t; i < b; i++) {
+        delete r->get(i);
+    }
+}
+
+void TaskScheduler::WorkStealingDeque::push(Task* task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring* r = ring.load(std::memory_order_relaxed);
+
+    if (b - t > r->capacity - 1) {
+        // Grow: copy live range into a ring twice the size
+        Ring* grown = new Ring(r->capacity * 2);
+        for (int64_t i = t; i < b; i++) {
+            grown->put(i, r->get(i));
+        }
+        rings.emplace_back(grown);
+        ring.store(grown, std::memory_order_release);
+        r = grown;
+    }
+
+    r->put(b, task);
+    // Release store (rather than a release fence) so thieves that acquire
+    // bottom also see the task contents; same cost on x86
+    bottom.store(b + 1, std::memory_order_release);
+}
+
+TaskScheduler::Task* TaskScheduler::WorkStealingDeque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Task* task = r->get(b);
+    if (t == b) {
+        // Last element: race against thieves
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+TaskScheduler::Task* TaskScheduler::WorkStealingDeque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return nullptr;
+    }
+
+    Ring* r = ring.load(std::memory_order_acquire);
+    Task* task = r->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+// ---------------------------------------------------------------------------
+// TaskGroup
+// ---------------------------------------------------------------------------
+
+TaskGroup::TaskGroup() : pending(0) {
+}
+
+bool TaskGroup::isDone() const {
+    return pending.load(std::memory_order_acquire) == 0;
+}
+
+// ---------------------------------------------------------------------------
+// TaskScheduler
+// ---------------------------------------------------------------------------
+
+TaskScheduler::TaskScheduler(int num_threads)
+    : queued_tasks(0), sleeping_workers(0), shutting_down(false) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back(new Worker());
+    }
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        shutting_down = true;
+    }
+    sleep_cv.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (auto& queue : injection_queues) {
+        for (Task* task : queue) {
+            delete task;
+        }
+    }
+}
+
+int TaskScheduler::getThreadCount() const {
+    return static_cast<int>(workers.size());
+}
+
+int TaskScheduler::currentWorkerIndex() {
+    return current_worker;
+}
+
+void TaskScheduler::submit(TaskFunction fn, Priority priority, TaskGroup* group) {
+    if (group != nullptr) {
+        group->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    enqueue(new Task{std::move(fn), group}, priority);
+}
+
+void TaskScheduler::enqueue(Task* task, Priority priority) {
+    int level = static_cast<int>(priority);
+
+    if (current_scheduler == this) {
+        workers[current_worker]->deques[level].push(task);
+    } else {
+        std::lock_guard<std::mutex> lock(injection_mutex);
+        injection_queues[level].push_back(task);
+    }
+
+    queued_tasks.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping_workers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_cv.notify_one();
+    }
+}
+
+void TaskScheduler::parallelFor(int64_t begin, int64_t end, int64_t grain,
+                                std::function<void(int64_t)> body,
+                                Priority priority, TaskGroup& group) {
+    if (begin >= end) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+
+    auto shared_body = std::make_shared<const std::function<void(int64_t)>>(std::move(body));
+    submitRange(begin, end, grain, std::move(shared_body), priority, group);
+}
+
+void TaskScheduler::submitRange(int64_t begin, int64_t end, int64_t grain, RangeBody body,
+                                Priority priority, TaskGroup& group) {
+    // Split the range in halves: the upper half becomes a stealable task,
+    // the lower half keeps being split by whoever runs it.
+    submit([this, begin, end, grain, body, priority, &group]() {
+        int64_t lo = begin;
+        int64_t hi = end;
+        while (hi - lo > grain) {
+            int64_t mid = lo + (hi - lo) / 2;
+            submitRange(mid, hi, grain, body, priority, group);
+            hi = mid;
+        }
+        for (int64_t i = lo; i < hi; i++) {
+            (*body)(i);
+        }
+    }, priority, &group);
+}
+
+TaskScheduler::Task* TaskScheduler::findTask(int index) {
+    int worker_count = static_cast<int>(workers.size());
+
+    for (int level = 0; level < kPriorityLevels; level++) {
+        // Own deque first (LIFO keeps caches warm) ...
+        if (index >= 0) {
+            if (Task* task = workers[index]->deques[level].pop()) {
+                return task;
+            }
+        }
+
+        // ... then work submitted from outside ...
+        {
+            std::lock_guard<std::mutex> lock(injection_mutex);
+            if (!injection_queues[level].empty()) {
+                Task* task = injection_queues[level].front();
+                injection_queues[level].pop_front();
+                return task;
+            }
+        }
+
+        // ... then steal from the other workers, starting next to us
+        for (int k = 1; k <= worker_count; k++) {
+            int victim = (index + k) % worker_count;
+            if (victim == index) {
+                continue;
+            }
+            if (Task* task = workers[victim]->deques[level].steal()) {
+                return task;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void TaskScheduler::execute(Task* task) {
+    queued_tasks.fetch_sub(1, std::memory_order_relaxed);
+
+    try {
+        task->fn();
+    } catch (const std::exception& e) {
+        std::cerr << "Task failed: " << e.what() << std::endl;
+    }
+
+    // Once the count drains, a waiter may destroy the group at any moment
+    if (task->group != nullptr && task->group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        notifyGroupDone();
+    }
+
+    delete task;
+}
+
+void TaskScheduler::notifyGroupDone() {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    done_cv.notify_all();
+}
+
+void TaskScheduler::wait(TaskGroup& group) {
+    if (current_scheduler == this) {
+        // Help out instead of blocking a worker
+        while (!group.isDone()) {
+            if (Task* task = findTask(current_worker)) {
+                execute(task);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    done_cv.wait(lock, [&group]() { return group.isDone(); });
+}
+
+void TaskScheduler::workerLoop(int index) {
+    current_scheduler = this;
+    current_worker = index;
+
+    while (true) {
+        Task* task = nullptr;
+        for (int spin = 0; spin < kSpinRounds && task == nullptr; spin++) {
+            task = findTask(index);
+            if (task == nullptr) {
+                std::this_thread::yield();
+            }
+        }
+
+        if (task != nullptr) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_workers.fetch_add(1, std::memory_order_seq_cst);
+        sleep_cv.wait(lock, [this]() {
+            return shutting_down || queued_tasks.load(std::memory_order_seq_cst) > 0;
+        });
+        sleeping_workers.fetch_sub(1, std::memory_order_seq_cst);
+
+        if (shutting_down && queued_tasks.load(std::memory_order_seq_cst) <= 0) {
+            return;
+        }
+    }
+}
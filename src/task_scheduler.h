@@ -0,0 +1,134 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Small work-stealing scheduler. Each worker owns one Chase-Lev deque per
+// priority level; tasks spawned from a worker go to its own deque, tasks
+// submitted from outside go to a shared injection queue. Idle workers steal
+// from the top of other workers' deques, high priority first.
+class TaskScheduler {
+public:
+    enum class Priority {
+        High = 0,    // Sub-image work that finishes an image already in flight
+        Normal = 1,  // New images
+    };
+
+    using TaskFunction = std::function<void()>;
+
+    explicit TaskScheduler(int num_threads);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Queue a task; if a group is given it stays pending until the task ran
+    void submit(TaskFunction fn, Priority priority = Priority::Normal, TaskGroup* group = nullptr);
+
+    // Run body(i) for every i in [begin, end) by recursive range splitting
+    void parallelFor(int64_t begin, int64_t end, int64_t grain,
+                     std::function<void(int64_t)> body,
+                     Priority priority, TaskGroup& group);
+
+    // Block until all tasks of the group are done. Called from a worker,
+    // the worker keeps executing other tasks while it waits.
+    void wait(TaskGroup& group);
+
+    int getThreadCount() const;
+
+    // Index of the calling worker in [0, getThreadCount()), or -1
+    static int currentWorkerIndex();
+
+private:
+    struct Task {
+        TaskFunction fn;
+        TaskGroup* group;
+    };
+
+    // Chase-Lev deque: the owning worker pushes and pops at the bottom,
+    // other workers steal from the top.
+    class WorkStealingDeque {
+    public:
+        WorkStealingDeque();
+        ~WorkStealingDeque();
+
+        void push(Task* task);
+        Task* pop();
+        Task* steal();
+
+    private:
+        struct Ring {
+            explicit Ring(int64_t capacity);
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Task*>[]> slots;
+
+            Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t i, Task* t) { slots[i & (capacity - 1)].store(t, std::memory_order_relaxed); }
+        };
+
+        std::atomic<int64_t> top;
+        std::atomic<int64_t> bottom;
+        std::atomic<Ring*> ring;
+        std::vector<std::unique_ptr<Ring>> rings;  // Retired rings stay alive for thieves
+    };
+
+    struct Worker {
+        WorkStealingDeque deques[2];
+    };
+
+    static const int kPriorityLevels = 2;
+
+    using RangeBody = std::shared_ptr<const std::function<void(int64_t)>>;
+
+    void enqueue(Task* task, Priority priority);
+    void submitRange(int64_t begin, int64_t end, int64_t grain, RangeBody body,
+                     Priority priority, TaskGroup& group);
+    void workerLoop(int index);
+    Task* findTask(int index);
+    void execute(Task* task);
+    void notifyGroupDone();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex injection_mutex;
+    std::deque<Task*> injection_queues[kPriorityLevels];
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::condition_variable done_cv;
+    std::atomic<int64_t> queued_tasks;
+    std::atomic<int> sleeping_workers;
+    bool shutting_down;
+};
+
+// Counts outstanding tasks. A task that depends on others is submitted by
+// the last of them (as the pipeline does for deferred hashing); submit from
+// inside a task of the group (as parallelFor does) if the group must not
+// drain between two submissions.
+class TaskGroup {
+public:
+    TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    bool isDone() const;
+
+private:
+    friend class TaskScheduler;
+
+    std::atomic<int64_t> pending;
+};
+
+#endif // TASK_SCHEDULER_H
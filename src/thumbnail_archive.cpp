@@ -0,0 +1,339 @@
+#include "thumbnail_archive.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char kMagic[8] = {'T', 'H', 'M', 'B', 'A', 'R', 'C', '1'};
+    const uint32_t kVersion = 1;
+
+    static_assert(sizeof(ThumbnailArchive::IndexHeader) % 8 == 0, "index entries must stay 8-byte aligned");
+    static_assert(sizeof(ThumbnailArchive::IndexEntry) == 32, "index entry layout changed");
+
+    // Sort by key and keep the first record of every key
+    void sortUnique(std::vector<std::pair<std::string, size_t>>& keys) {
+        std::stable_sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        keys.erase(std::unique(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+            return a.first == b.first;
+        }), keys.end());
+    }
+
+    void appendEntries(const std::vector<std::pair<std::string, size_t>>& keys,
+                       const std::vector<ThumbnailArchive::Record>& records,
+                       std::vector<ThumbnailArchive::IndexEntry>& entries,
+                       std::string& key_bytes) {
+        for (const auto& key : keys) {
+            const ThumbnailArchive::Record& record = records[key.second];
+            ThumbnailArchive::IndexEntry entry;
+            entry.key_offset = key_bytes.size();
+            entry.offset = record.offset;
+            entry.key_length = static_cast<uint32_t>(key.first.size());
+            entry.segment = record.segment;
+            entry.length = record.length;
+            entry.width = record.width;
+            entry.height = record.height;
+            entries.push_back(entry);
+            key_bytes += key.first;
+        }
+    }
+}
+
+std::string ThumbnailArchive::segmentPath(const std::string& directory, uint32_t segment) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%05u.dat", segment);
+    return (fs::path(directory) / name).string();
+}
+
+// ---------------------------------------------------------------------------
+// ArchiveWriter
+// ---------------------------------------------------------------------------
+
+ArchiveWriter::ArchiveWriter()
+    : segment_bytes(ThumbnailArchive::kDefaultSegmentBytes), segment_file(nullptr),
+      segment(0), segment_offset(0) {}
+
+ArchiveWriter::~ArchiveWriter() {
+    if (segment_file != nullptr) {
+        std::fclose(segment_file);
+    }
+}
+
+bool ArchiveWriter::open(const std::string& directory, uint64_t segment_bytes) {
+    this->directory = directory;
+    this->segment_bytes = segment_bytes > 0 ? segment_bytes : ThumbnailArchive::kDefaultSegmentBytes;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+
+    // Drop the segments of a previous archive so none are left behind
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, 8, "segment-") == 0 && entry.path().extension() == ".dat") {
+            fs::remove(entry.path(), ec);
+        }
+    }
+    fs::remove(fs::path(directory) / ThumbnailArchive::kIndexFileName, ec);
+
+    segment = 0;
+    return openSegment();
+}
+
+bool ArchiveWriter::openSegment() {
+    std::string path = ThumbnailArchive::segmentPath(directory, segment);
+    segment_file = std::fopen(path.c_str(), "wb");
+    segment_offset = 0;
+    if (segment_file == nullptr) {
+        std::cerr << "Failed to create archive segment: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ArchiveWriter::append(const std::string& source_path, const std::string& digest,
+                           const unsigned char* jpeg, size_t length, int width, int height) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (segment_file != nullptr && segment_offset > 0 && segment_offset + length > segment_bytes) {
+        std::fclose(segment_file);
+        segment++;
+        openSegment();
+    }
+    if (segment_file == nullptr || std::fwrite(jpeg, 1, length, segment_file) != length) {
+        return false;
+    }
+
+    records.push_back(ThumbnailArchive::Record{segment, segment_offset, static_cast<uint32_t>(length),
+                                               static_cast<uint16_t>(width), static_cast<uint16_t>(height)});
+    segment_offset += length;
+
+    paths.emplace_back(source_path, records.size() - 1);
+    if (!digest.empty()) {
+        digests.emplace_back(digest, records.size() - 1);
+    }
+    return true;
+}
+
+void ArchiveWriter::addAlias(const std::string& source_path, const std::string& canonical_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    aliases.emplace_back(source_path, canonical_path);
+}
+
+bool ArchiveWriter::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    bool ok = true;
+    if (segment_file != nullptr) {
+        ok = std::fclose(segment_file) == 0;
+        segment_file = nullptr;
+    }
+
+    std::unordered_map<std::string, size_t> by_path(paths.begin(), paths.end());
+    for (const auto& alias : aliases) {
+        auto it = by_path.find(alias.second);
+        if (it != by_path.end()) {
+            paths.emplace_back(alias.first, it->second);
+        }
+    }
+
+    sortUnique(paths);
+    sortUnique(digests);
+
+    std::vector<ThumbnailArchive::IndexEntry> entries;
+    entries.reserve(paths.size() + digests.size());
+    std::string key_bytes;
+    appendEntries(paths, records, entries, key_bytes);
+    appendEntries(digests, records, entries, key_bytes);
+
+    ThumbnailArchive::IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.segment_count = segment + 1;
+    header.path_count = paths.size();
+    header.digest_count = digests.size();
+    header.key_bytes = key_bytes.size();
+
+    fs::path index_path = fs::path(directory) / ThumbnailArchive::kIndexFileName;
+    fs::path temp_path = index_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream index(temp_path, std::ios::binary | std::ios::trunc);
+        index.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        index.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(entries[0]));
+        index.write(key_bytes.data(), key_bytes.size());
+        ok = ok && static_cast<bool>(index);
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, index_path, ec);
+    if (!ok || ec) {
+        std::cerr << "Failed to write archive index: " << index_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// ArchiveReader
+// ---------------------------------------------------------------------------
+
+ArchiveReader::ArchiveReader()
+    : header(nullptr), path_entries(nullptr), digest_entries(nullptr), keys(nullptr) {}
+
+ArchiveReader::~ArchiveReader() {
+    close();
+}
+
+bool ArchiveReader::open(const std::string& directory) {
+    close();
+    this->directory = directory;
+
+    std::string index_path = (fs::path(directory) / ThumbnailArchive::kIndexFileName).string();
+    if (!index.open(index_path, MappedFile::Access::Random) ||
+        index.size() < sizeof(ThumbnailArchive::IndexHeader)) {
+        std::cerr << "Failed to open archive index: " << index_path << std::endl;
+        index.close();
+        return false;
+    }
+
+    header = reinterpret_cast<const ThumbnailArchive::IndexHeader*>(index.data());
+    // The counts come from the file, so size the sections without overflowing
+    uint64_t body = index.size() - sizeof(ThumbnailArchive::IndexHeader);
+    uint64_t max_entries = body / sizeof(ThumbnailArchive::IndexEntry);
+    bool valid = std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->version == kVersion &&
+                 header->path_count <= max_entries && header->digest_count <= max_entries - header->path_count &&
+                 header->key_bytes == body - (header->path_count + header->digest_count) *
+                                                 sizeof(ThumbnailArchive::IndexEntry);
+    if (!valid) {
+        std::cerr << "Invalid archive index: " << index_path << std::endl;
+        close();
+        return false;
+    }
+
+    path_entries = reinterpret_cast<const ThumbnailArchive::IndexEntry*>(
+        index.data() + sizeof(ThumbnailArchive::IndexHeader));
+    digest_entries = path_entries + header->path_count;
+    keys = reinterpret_cast<const char*>(digest_entries + header->digest_count);
+
+    for (uint32_t i = 0; i < header->segment_count; i++) {
+        std::string path = ThumbnailArchive::segmentPath(directory, i);
+        std::error_code ec;
+        uintmax_t size = fs::file_size(path, ec);
+        segment_sizes.push_back(ec ? 0 : size);
+#ifndef _WIN32
+        segment_fds.push_back(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+#endif
+    }
+
+    // Every record must point into the key bytes and into its segment
+    uint64_t entry_count = header->path_count + header->digest_count;
+    for (uint64_t i = 0; i < entry_count; i++) {
+        if (!inBounds(path_entries[i])) {
+            std::cerr << "Invalid archive index: " << index_path << " (record " << i
+                      << " lies outside its key or segment)" << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ArchiveReader::inBounds(const ThumbnailArchive::IndexEntry& entry) const {
+    return entry.key_offset <= header->key_bytes &&
+           entry.key_length <= header->key_bytes - entry.key_offset &&
+           entry.segment < segment_sizes.size() &&
+           entry.offset <= segment_sizes[entry.segment] &&
+           entry.length <= segment_sizes[entry.segment] - entry.offset;
+}
+
+void ArchiveReader::close() {
+#ifndef _WIN32
+    for (int fd : segment_fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#endif
+    segment_fds.clear();
+    segment_sizes.clear();
+    index.close();
+    header = nullptr;
+    path_entries = nullptr;
+    digest_entries = nullptr;
+    keys = nullptr;
+}
+
+bool ArchiveReader::find(const ThumbnailArchive::IndexEntry* entries, uint64_t count,
+                         const std::string& key, ThumbnailArchive::Record& record) const {
+    if (header == nullptr) {
+        return false;
+    }
+
+    auto key_of = [this](const ThumbnailArchive::IndexEntry& entry) {
+        return std::string_view(keys + entry.key_offset, entry.key_length);
+    };
+    const ThumbnailArchive::IndexEntry* end = entries + count;
+    const ThumbnailArchive::IndexEntry* it = std::lower_bound(entries, end, key,
+        [&key_of](const ThumbnailArchive::IndexEntry& entry, const std::string& value) {
+            return key_of(entry) < std::string_view(value);
+        });
+    if (it == end || key_of(*it) != std::string_view(key) || !inBounds(*it)) {
+        return false;
+    }
+
+    record = ThumbnailArchive::Record{it->segment, it->offset, it->length, it->width, it->height};
+    return true;
+}
+
+bool ArchiveReader::findByPath(const std::string& source_path, ThumbnailArchive::Record& record) const {
+    return header != nullptr && find(path_entries, header->path_count, source_path, record);
+}
+
+bool ArchiveReader::findByDigest(const std::string& digest, ThumbnailArchive::Record& record) const {
+    return header != nullptr && find(digest_entries, header->digest_count, digest, record);
+}
+
+bool ArchiveReader::read(const ThumbnailArchive::Record& record, std::vector<unsigned char>& out) const {
+    out.resize(record.length);
+#ifndef _WIN32
+    if (record.segment >= segment_fds.size() || segment_fds[record.segment] < 0) {
+        return false;
+    }
+    size_t done = 0;
+    while (done < record.length) {
+        ssize_t n = pread(segment_fds[record.segment], out.data() + done, record.length - done,
+                          static_cast<off_t>(record.offset + done));
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+#else
+    std::ifstream segment(ThumbnailArchive::segmentPath(directory, record.segment), std::ios::binary);
+    segment.seekg(static_cast<std::streamoff>(record.offset));
+    segment.read(reinterpret_cast<char*>(out.data()), record.length);
+    return static_cast<bool>(segment);
+#endif
+}
+
+uint64_t ArchiveReader::getPathCount() const {
+    return header != nullptr ? header->path_count : 0;
+}
+
+uint64_t ArchiveReader::getDigestCount() const {
+    return header != nullptr ? header->digest_count : 0;
+}
@@ -0,0 +1,135 @@
+#ifndef THUMBNAIL_ARCHIVE_H
+#define THUMBNAIL_ARCHIVE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Packed thumbnail archive: encoded JPEGs are appended back to back into
+// large segment files ("segment-00000.dat", ...) and a sorted index
+// ("archive.idx") maps source paths and content digests to their location.
+// The index is laid out to be memory-mapped and binary-searched in place:
+//
+//   IndexHeader
+//   IndexEntry[path_count]    sorted by source path
+//   IndexEntry[digest_count]  sorted by content digest
+//   key bytes                 referenced by IndexEntry::key_offset
+//
+// Integers are stored in host byte order.
+namespace ThumbnailArchive {
+    static const char kIndexFileName[] = "archive.idx";
+    static const uint64_t kDefaultSegmentBytes = 1ull << 30;
+
+    struct Record {
+        uint32_t segment;
+        uint64_t offset;
+        uint32_t length;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    struct IndexHeader {
+        char magic[8];  // "THMBARC1"
+        uint32_t version;
+        uint32_t segment_count;
+        uint64_t path_count;
+        uint64_t digest_count;
+        uint64_t key_bytes;
+    };
+
+    struct IndexEntry {
+        uint64_t key_offset;
+        uint64_t offset;
+        uint32_t key_length;
+        uint32_t segment;
+        uint32_t length;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    std::string segmentPath(const std::string& directory, uint32_t segment);
+}
+
+// Appends thumbnails to an archive; append() may be called from any thread
+class ArchiveWriter {
+public:
+    ArchiveWriter();
+    ~ArchiveWriter();
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    // Start a new archive in directory, replacing one that is already there
+    bool open(const std::string& directory, uint64_t segment_bytes = ThumbnailArchive::kDefaultSegmentBytes);
+
+    bool append(const std::string& source_path, const std::string& digest,
+                const unsigned char* jpeg, size_t length, int width, int height);
+
+    // Index source_path under the thumbnail already appended for canonical_path
+    void addAlias(const std::string& source_path, const std::string& canonical_path);
+
+    // Close the last segment and write the index
+    bool finish();
+
+private:
+    bool openSegment();
+
+    std::string directory;
+    uint64_t segment_bytes;
+
+    std::mutex mutex;
+    std::FILE* segment_file;
+    uint32_t segment;
+    uint64_t segment_offset;
+
+    std::vector<ThumbnailArchive::Record> records;
+    std::vector<std::pair<std::string, size_t>> paths;    // -> records
+    std::vector<std::pair<std::string, size_t>> digests;  // -> records
+    std::vector<std::pair<std::string, std::string>> aliases;
+};
+
+// Random access to a finished archive: lookups binary-search the mapped
+// index, and each thumbnail is then a single positional read
+class ArchiveReader {
+public:
+    ArchiveReader();
+    ~ArchiveReader();
+
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    bool open(const std::string& directory);
+    void close();
+
+    bool findByPath(const std::string& source_path, ThumbnailArchive::Record& record) const;
+    bool findByDigest(const std::string& digest, ThumbnailArchive::Record& record) const;
+
+    // Read the JPEG bytes of record into out
+    bool read(const ThumbnailArchive::Record& record, std::vector<unsigned char>& out) const;
+
+    uint64_t getPathCount() const;
+    uint64_t getDigestCount() const;
+
+private:
+    bool find(const ThumbnailArchive::IndexEntry* entries, uint64_t count,
+              const std::string& key, ThumbnailArchive::Record& record) const;
+    // Whether the entry's key lies in the key bytes and its thumbnail in its segment
+    bool inBounds(const ThumbnailArchive::IndexEntry& entry) const;
+
+    std::string directory;
+    MappedFile index;
+    const ThumbnailArchive::IndexHeader* header;
+    const ThumbnailArchive::IndexEntry* path_entries;
+    const ThumbnailArchive::IndexEntry* digest_entries;
+    const char* keys;
+    std::vector<int> segment_fds;
+    std::vector<uint64_t> segment_sizes;
+};
+
+#endif // THUMBNAIL_ARCHIVE_H
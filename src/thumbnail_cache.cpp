@@ -0,0 +1,217 @@
+#include "thumbnail_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace {
+    // Typical encoded thumbnail, used to size the frequency sketch
+    const size_t kExpectedEntrySize = 16 * 1024;
+
+    const int kSketchRows = 4;
+    const uint8_t kMaxCount = 15;
+    const uint64_t kRowSeeds[kSketchRows] = {
+        0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+    };
+}
+
+ThumbnailCache::FrequencySketch::FrequencySketch(size_t expected_entries) : additions(0) {
+    size_t width = 1024;
+    while (width < expected_entries) {
+        width <<= 1;
+    }
+    counters.assign(width * kSketchRows, 0);
+    width_mask = width - 1;
+    sample_size = 10 * width;
+}
+
+size_t ThumbnailCache::FrequencySketch::indexOf(uint64_t hash, int row) const {
+    uint64_t h = hash * kRowSeeds[row];
+    h ^= h >> 32;
+    return static_cast<size_t>(row) * (width_mask + 1) + (h & width_mask);
+}
+
+void ThumbnailCache::FrequencySketch::increment(uint64_t hash) {
+    for (int row = 0; row < kSketchRows; row++) {
+        uint8_t& counter = counters[indexOf(hash, row)];
+        if (counter < kMaxCount) {
+            counter++;
+        }
+    }
+
+    // Age: halve every counter once per sample period
+    if (++additions >= sample_size) {
+        for (uint8_t& counter : counters) {
+            counter >>= 1;
+        }
+        additions /= 2;
+    }
+}
+
+int ThumbnailCache::FrequencySketch::estimate(uint64_t hash) const {
+    int count = kMaxCount;
+    for (int row = 0; row < kSketchRows; row++) {
+        count = std::min<int>(count, counters[indexOf(hash, row)]);
+    }
+    return count;
+}
+
+ThumbnailCache::ThumbnailCache(size_t capacity_bytes)
+    : sketch(capacity_bytes / kExpectedEntrySize),
+      window_capacity(capacity_bytes / 100),
+      main_capacity(capacity_bytes - capacity_bytes / 100),
+      protected_capacity(main_capacity / 5 * 4),
+      window_bytes(0),
+      probation_bytes(0),
+      protected_bytes(0),
+      hits(0),
+      misses(0),
+      rejected(0),
+      evicted(0) {
+}
+
+ThumbnailCache::Value ThumbnailCache::get(const std::string& key) {
+    uint64_t hash = std::hash<std::string>()(key);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    sketch.increment(hash);
+
+    auto found = entries.find(key);
+    if (found == entries.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+
+    EntryList::iterator entry = found->second;
+    switch (entry->segment) {
+        case Segment::Window:
+            window.splice(window.begin(), window, entry);
+            break;
+        case Segment::Probation:
+            // Second hit in the main segment: promote
+            moveTo(entry, Segment::Protected);
+            while (protected_bytes > protected_capacity) {
+                demoteProtected();
+            }
+            break;
+        case Segment::Protected:
+            protected_entries.splice(protected_entries.begin(), protected_entries, entry);
+            break;
+    }
+    return entry->value;
+}
+
+void ThumbnailCache::put(const std::string& key, Value value) {
+    if (!value) {
+        return;
+    }
+    uint64_t hash = std::hash<std::string>()(key);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+        remove(found->second);
+    }
+    if (value->size() > main_capacity) {
+        rejected++;
+        return;
+    }
+
+    window.push_front(Entry{key, std::move(value), hash, Segment::Window});
+    window_bytes += window.front().value->size();
+    entries[key] = window.begin();
+    evictWindow();
+}
+
+ThumbnailCache::Value ThumbnailCache::peek(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(key);
+    return found == entries.end() ? nullptr : found->second->value;
+}
+
+ThumbnailCache::Stats ThumbnailCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.rejected = rejected;
+    stats.evicted = evicted;
+    stats.entries = entries.size();
+    stats.bytes = window_bytes + probation_bytes + protected_bytes;
+    return stats;
+}
+
+ThumbnailCache::EntryList& ThumbnailCache::listOf(Segment segment) {
+    switch (segment) {
+        case Segment::Window: return window;
+        case Segment::Probation: return probation;
+        case Segment::Protected: return protected_entries;
+    }
+    return window;
+}
+
+size_t& ThumbnailCache::bytesOf(Segment segment) {
+    switch (segment) {
+        case Segment::Window: return window_bytes;
+        case Segment::Probation: return probation_bytes;
+        case Segment::Protected: return protected_bytes;
+    }
+    return window_bytes;
+}
+
+void ThumbnailCache::moveTo(EntryList::iterator entry, Segment segment) {
+    size_t size = entry->value->size();
+    bytesOf(entry->segment) -= size;
+    listOf(segment).splice(listOf(segment).begin(), listOf(entry->segment), entry);
+    entry->segment = segment;
+    bytesOf(segment) += size;
+}
+
+void ThumbnailCache::remove(EntryList::iterator entry) {
+    bytesOf(entry->segment) -= entry->value->size();
+    entries.erase(entry->key);
+    listOf(entry->segment).erase(entry);
+}
+
+void ThumbnailCache::evictWindow() {
+    while (window_bytes > window_capacity && !window.empty()) {
+        admit(std::prev(window.end()));
+    }
+}
+
+void ThumbnailCache::admit(EntryList::iterator candidate) {
+    size_t size = candidate->value->size();
+    if (probation_bytes + protected_bytes + size <= main_capacity) {
+        moveTo(candidate, Segment::Probation);
+        return;
+    }
+
+    // Victims in eviction order (probation first) until the candidate
+    // fits; it is only admitted if it is more popular than each of them
+    int candidate_frequency = sketch.estimate(candidate->hash);
+    std::vector<EntryList::iterator> victims;
+    size_t freed = 0;
+    size_t needed = probation_bytes + protected_bytes + size - main_capacity;
+    for (EntryList* list : {&probation, &protected_entries}) {
+        for (auto it = list->rbegin(); it != list->rend() && freed < needed; ++it) {
+            if (sketch.estimate(it->hash) >= candidate_frequency) {
+                remove(candidate);
+                rejected++;
+                return;
+            }
+            victims.push_back(std::prev(it.base()));
+            freed += it->value->size();
+        }
+    }
+
+    for (EntryList::iterator victim : victims) {
+        remove(victim);
+        evicted++;
+    }
+    moveTo(candidate, Segment::Probation);
+}
+
+void ThumbnailCache::demoteProtected() {
+    moveTo(std::prev(protected_entries.end()), Segment::Probation);
+}
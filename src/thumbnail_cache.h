@@ -0,0 +1,108 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory cache of encoded thumbnails bounded by total bytes, using
+// W-TinyLFU: new entries land in a small LRU window; entries leaving the
+// window are admitted to the main segmented LRU (probation + protected)
+// only if a count-min sketch of recent accesses says they are used more
+// often than the entries they would evict. Keeps one-hit wonders from
+// flushing popular thumbnails. Thread safe.
+class ThumbnailCache {
+public:
+    using Value = std::shared_ptr<const std::vector<unsigned char>>;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t rejected;  // Not admitted to the main segment
+        uint64_t evicted;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit ThumbnailCache(size_t capacity_bytes);
+
+    // Cached value or nullptr; counts as an access either way
+    Value get(const std::string& key);
+
+    // Cached value or nullptr, without counting an access
+    Value peek(const std::string& key) const;
+
+    // Insert or replace; values larger than the main segment are dropped
+    void put(const std::string& key, Value value);
+
+    Stats getStats() const;
+
+private:
+    // Approximate access counts: 4-bit saturating counters in four rows,
+    // all halved periodically so old popularity fades
+    class FrequencySketch {
+    public:
+        explicit FrequencySketch(size_t expected_entries);
+
+        void increment(uint64_t hash);
+        int estimate(uint64_t hash) const;
+
+    private:
+        size_t indexOf(uint64_t hash, int row) const;
+
+        std::vector<uint8_t> counters;
+        size_t width_mask;
+        size_t additions;
+        size_t sample_size;
+    };
+
+    enum class Segment {
+        Window,
+        Probation,
+        Protected,
+    };
+
+    struct Entry {
+        std::string key;
+        Value value;
+        uint64_t hash;
+        Segment segment;
+    };
+
+    using EntryList = std::list<Entry>;  // Front is most recently used
+
+    EntryList& listOf(Segment segment);
+    size_t& bytesOf(Segment segment);
+    void moveTo(EntryList::iterator entry, Segment segment);
+    void remove(EntryList::iterator entry);
+    void evictWindow();
+    void admit(EntryList::iterator candidate);
+    void demoteProtected();
+
+    mutable std::mutex mutex;
+    FrequencySketch sketch;
+
+    size_t window_capacity;
+    size_t main_capacity;
+    size_t protected_capacity;
+
+    EntryList window;
+    EntryList probation;
+    EntryList protected_entries;
+    size_t window_bytes;
+    size_t probation_bytes;
+    size_t protected_bytes;
+    std::unordered_map<std::string, EntryList::iterator> entries;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t rejected;
+    uint64_t evicted;
+};
+
+#endif // THUMBNAIL_CACHE_H
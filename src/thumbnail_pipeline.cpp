@@ -0,0 +1,514 @@
+#include "thumbnail_pipeline.h"
+#include "content_store.h"
+#include "hash_calculator.h"
+#include "image_processor.h"
+#include "locality_sorter.h"
+#include "mapped_file.h"
+#include "output_linker.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+ThumbnailPipeline::ThumbnailPipeline(const Config& config, TaskScheduler& scheduler)
+    : config(config), scheduler(scheduler),
+      worker_results(scheduler.getThreadCount()), keep_results(true), full_digests(false),
+      success_count(0), failure_count(0), skipped_count(0), linked_count(0), in_flight(0), backlog_waiting(false) {
+    if (config.skip_exact_duplicates) {
+        content_hashes.reset(new ContentHashSet());
+    }
+    if (config.layout == ThumbnailLayout::Archive) {
+        archive.reset(new ArchiveWriter());
+        archive->open(config.output_dir);
+    } else if (config.layout == ThumbnailLayout::Atlas) {
+        atlas.reset(new AtlasBuilder());
+        atlas->open(config.output_dir, config.atlas_size);
+    }
+    if (config.reader == ReaderBackend::Threads || config.reader == ReaderBackend::IoUring) {
+        // Enough buffers to keep every read slot and every worker busy
+        buffer_pool.reset(new BufferPool(config.queue_depth + scheduler.getThreadCount()));
+        reader.reset(new AsyncReader(config.reader, config.queue_depth, *buffer_pool,
+            [this](AsyncReader::Request request, BufferPool::Buffer* buffer) {
+                this->scheduler.submit([this, request = std::move(request), buffer]() mutable {
+                    processBuffer(std::move(request), buffer);
+                }, TaskScheduler::Priority::Normal, &group);
+            }));
+    }
+}
+
+ThumbnailPipeline::~ThumbnailPipeline() {
+    // Stop the reader before the pool its buffers belong to
+    reader.reset();
+}
+
+void ThumbnailPipeline::submit(std::string filepath, uint64_t order, int64_t file_size) {
+    in_flight.fetch_add(1, std::memory_order_relaxed);
+
+    if (reader && !isKnownDuplicate(order)) {
+        AsyncReader::Request request{std::move(filepath), order, file_size};
+        if (TaskScheduler::currentWorkerIndex() < 0) {
+            reader->submit(std::move(request));
+            return;
+        }
+        if (reader->trySubmit(request)) {
+            return;
+        }
+        // A worker (such as a directory scan task) must not wait for the
+        // reader, whose buffers only workers release: read this one itself
+        filepath = std::move(request.filepath);
+    }
+
+    scheduler.submit([this, filepath = std::move(filepath), order, file_size]() mutable {
+        processFile(std::move(filepath), order, file_size);
+    }, TaskScheduler::Priority::Normal, &group);
+}
+
+void ThumbnailPipeline::submitAll(const std::vector<std::string>& image_files) {
+    if (reader) {
+        // The reader stage decides the pace; just queue everything in order
+        for (size_t i = 0; i < image_files.size(); i++) {
+            submit(image_files[i], i);
+        }
+        return;
+    }
+
+    in_flight.fetch_add(image_files.size(), std::memory_order_relaxed);
+    scheduler.parallelFor(0, image_files.size(), 1, [this, &image_files](int64_t i) {
+        processFile(image_files[i], i, -1);
+    }, TaskScheduler::Priority::Normal, group);
+}
+
+void ThumbnailPipeline::submitInOrder(const std::vector<std::string>& image_files, int prefetch_window) {
+    // External submissions go through the scheduler's FIFO injection queue,
+    // so workers pick images up in list order
+    size_t window = prefetch_window > 0 ? prefetch_window : 1;
+    size_t prefetched = 0;
+
+    for (size_t i = 0; i < image_files.size(); i++) {
+        while (prefetched < image_files.size() && prefetched < i + 2 * window) {
+            LocalitySorter::prefetch(image_files[prefetched++]);
+        }
+        submit(image_files[i], i);
+        waitForBacklog(window);
+    }
+}
+
+void ThumbnailPipeline::setExactDuplicates(ExactDuplicateFinder::Result duplicates) {
+    exact_duplicates.reset(new ExactDuplicateFinder::Result(std::move(duplicates)));
+    content_hashes.reset();
+}
+
+bool ThumbnailPipeline::isKnownDuplicate(uint64_t order) const {
+    return exact_duplicates && order < exact_duplicates->duplicate_of.size() &&
+           !exact_duplicates->duplicate_of[order].empty();
+}
+
+std::string ThumbnailPipeline::getKnownDigest(uint64_t order) const {
+    return order < exact_duplicates->digests.size() ? exact_duplicates->digests[order] : std::string();
+}
+
+void ThumbnailPipeline::setFullDigests(bool full) {
+    full_digests = full;
+}
+
+void ThumbnailPipeline::setKeepResults(bool keep) {
+    keep_results = keep || config.skip_exact_duplicates || archive || atlas;
+}
+
+void ThumbnailPipeline::setCompletionListener(CompletionListener listener) {
+    completion_listener = std::move(listener);
+}
+
+TaskGroup& ThumbnailPipeline::getGroup() {
+    return group;
+}
+
+void ThumbnailPipeline::wait() {
+    scheduler.wait(group);
+    if (reader) {
+        // Producers are done; decode tasks for reads still in flight join
+        // the group when their buffers are delivered
+        reader->drain();
+        scheduler.wait(group);
+    }
+    if (config.skip_exact_duplicates) {
+        resolveDuplicates();
+        // Sharded outputs are shared by construction, nothing to link
+        if (config.duplicate_output != DuplicateOutput::None && config.layout == ThumbnailLayout::Flat) {
+            linkDuplicateOutputs();
+        }
+    }
+    if (archive || atlas) {
+        finishPackedOutput();
+    }
+}
+
+ReaderBackend ThumbnailPipeline::getReaderBackend() const {
+    return reader ? reader->getBackend() : config.reader;
+}
+
+void ThumbnailPipeline::waitForBacklog(int64_t max_in_flight) {
+    std::unique_lock<std::mutex> lock(backlog_mutex);
+    backlog_waiting.store(true, std::memory_order_seq_cst);
+    backlog_cv.wait(lock, [this, max_in_flight]() {
+        return in_flight.load(std::memory_order_seq_cst) <= max_in_flight;
+    });
+    backlog_waiting.store(false, std::memory_order_relaxed);
+}
+
+ThumbnailPipeline::ImageResult& ThumbnailPipeline::beginImage(std::string filepath, uint64_t order,
+                                                              int64_t file_size) {
+    ImageResult result{std::move(filepath), std::string(), 0, order, file_size, std::string(), false};
+    if (!keep_results) {
+        return *new ImageResult(std::move(result));
+    }
+    std::deque<ImageResult>& results = worker_results[TaskScheduler::currentWorkerIndex()];
+    results.push_back(std::move(result));
+    return results.back();
+}
+
+void ThumbnailPipeline::finishImage(bool success) {
+    if (success) {
+        success_count.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        failure_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    in_flight.fetch_sub(1, std::memory_order_seq_cst);
+    if (backlog_waiting.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(backlog_mutex);
+        backlog_cv.notify_all();
+    }
+}
+
+void ThumbnailPipeline::releaseImage(ImageResult& result) {
+    if (!keep_results) {
+        delete &result;
+    }
+}
+
+void ThumbnailPipeline::notifyCompleted(const ImageResult& result) {
+    if (completion_listener && result.success) {
+        completion_listener(result);
+    }
+}
+
+void ThumbnailPipeline::processFile(std::string filepath, uint64_t order, int64_t file_size) {
+    if (isKnownDuplicate(order)) {
+        // Identical to an earlier file: nothing to read or decode
+        ImageResult& result = beginImage(std::move(filepath), order, file_size);
+        result.md5 = getKnownDigest(order);
+        result.duplicate_of = exact_duplicates->duplicate_of[order];
+        result.success = true;  // Settled by resolveDuplicates()
+        skipped_count.fetch_add(1, std::memory_order_relaxed);
+        finishImage(true);
+    } else if (config.reader == ReaderBackend::Mmap) {
+        processMapped(std::move(filepath), order, file_size);
+    } else if (content_hashes || archive || atlas) {
+        // Early duplicate checks and packed outputs need the bytes in memory
+        processRead(std::move(filepath), order, file_size);
+    } else {
+        processImage(std::move(filepath), order, file_size);
+    }
+}
+
+void ThumbnailPipeline::processImage(std::string filepath, uint64_t order, int64_t file_size) {
+    ImageResult& result = beginImage(std::move(filepath), order, file_size);
+
+    // Per-image temporaries are released when the scope closes
+    ScratchArena::Scope scratch(ScratchArena::local());
+
+    // Generate output path
+    ArenaString output_path = buildOutputPath(config.output_dir, result.filepath);
+
+    // Process image
+    bool success = false;
+    result.phash = ImageProcessor::processSingleImage(
+        result.filepath, output_path.c_str(), config.thumbnail_size, success
+    );
+    result.success = success;
+
+    if (success && exact_duplicates) {
+        result.md5 = getKnownDigest(order);
+    }
+    bool deferred = success && result.md5.empty() && (!exact_duplicates || full_digests);
+    if (success && !deferred) {
+        notifyCompleted(result);
+    } else if (deferred) {
+        // Hash as a separate task; high priority so in-flight images
+        // complete before new ones start
+        ImageResult* pending = &result;
+        scheduler.submit([this, pending]() {
+            pending->md5 = HashCalculator::calculateMD5(pending->filepath);
+            notifyCompleted(*pending);
+            releaseImage(*pending);
+        }, TaskScheduler::Priority::High, &group);
+    }
+
+    finishImage(success);
+    if (!deferred) {
+        releaseImage(result);
+    }
+}
+
+void ThumbnailPipeline::processBuffer(AsyncReader::Request request, BufferPool::Buffer* buffer) {
+    ImageResult& result = beginImage(std::move(request.filepath), request.order,
+                                     buffer ? static_cast<int64_t>(buffer->size) : request.file_size);
+
+    if (buffer == nullptr) {
+        std::cerr << "Failed to read image: " << result.filepath << std::endl;
+        finishImage(false);
+        releaseImage(result);
+        return;
+    }
+
+    // Decode and hash straight from the buffer: the file is read only once
+    bool success = processContents(result, buffer->data.get(), buffer->size);
+
+    buffer_pool->release(buffer);
+    if (result.duplicate_of.empty()) {
+        notifyCompleted(result);
+    }
+    finishImage(success);
+    releaseImage(result);
+}
+
+void ThumbnailPipeline::processMapped(std::string filepath, uint64_t order, int64_t file_size) {
+    MappedFile file;
+    if (!file.open(filepath)) {
+        // Empty, special or unmappable file: let the regular path report it
+        processImage(std::move(filepath), order, file_size);
+        return;
+    }
+
+    ImageResult& result = beginImage(std::move(filepath), order, static_cast<int64_t>(file.size()));
+
+    // Decode and hash straight from the page cache, no copy into a buffer
+    bool success = processContents(result, file.data(), file.size());
+
+    file.close();
+    if (result.duplicate_of.empty()) {
+        notifyCompleted(result);
+    }
+    finishImage(success);
+    releaseImage(result);
+}
+
+void ThumbnailPipeline::processRead(std::string filepath, uint64_t order, int64_t file_size) {
+    ScratchArena::Scope scratch(ScratchArena::local());
+
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file) {
+        ImageResult& result = beginImage(std::move(filepath), order, file_size);
+        std::cerr << "Failed to read image: " << result.filepath << std::endl;
+        finishImage(false);
+        releaseImage(result);
+        return;
+    }
+
+    size_t size = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+    ArenaVector<unsigned char> contents(size);
+    file.read(reinterpret_cast<char*>(contents.data()), size);
+    file.close();
+
+    ImageResult& result = beginImage(std::move(filepath), order, static_cast<int64_t>(size));
+    bool success = processContents(result, contents.data(), contents.size());
+    if (result.duplicate_of.empty()) {
+        notifyCompleted(result);
+    }
+    finishImage(success);
+    releaseImage(result);
+}
+
+bool ThumbnailPipeline::processContents(ImageResult& result, const unsigned char* data, size_t length) {
+    if (content_hashes) {
+        // Hash before decoding: byte-identical files share the thumbnail of
+        // the first one seen and skip decode, resize and encode entirely
+        result.md5 = HashCalculator::calculateMD5(data, length);
+        if (!content_hashes->insert(result.md5, result.filepath, result.duplicate_of)) {
+            skipped_count.fetch_add(1, std::memory_order_relaxed);
+            result.success = true;  // Settled by resolveDuplicates()
+            return true;
+        }
+    }
+
+    if (archive) {
+        // Reused across images so the encoder output rarely reallocates
+        thread_local ImageProcessor::EncodedThumbnail encoded;
+        bool success = false;
+        result.phash = ImageProcessor::processEncodedImage(
+            data, length, result.filepath, config.thumbnail_size, encoded, success
+        );
+        result.success = success && archive->append(result.filepath, result.md5, encoded.jpeg.data(),
+                                                    encoded.jpeg.size(), encoded.width, encoded.height);
+        return result.success;
+    }
+    if (atlas) {
+        bool success = false;
+        result.phash = ImageProcessor::processEncodedImage(
+            data, length, result.filepath, config.thumbnail_size,
+            [this, &result](const ImageProcessor::ImageData& thumbnail) {
+                return atlas->add(result.filepath, thumbnail);
+            }, success
+        );
+        result.success = success;
+        return success;
+    }
+
+    ScratchArena::Scope scratch(ScratchArena::local());
+    ArenaString output_path;
+    if (config.layout == ThumbnailLayout::Sharded) {
+        // The digest was computed above; it names the thumbnail
+        if (!ContentStore::createShardDirectories(config.output_dir, result.md5)) {
+            result.success = false;
+            return false;
+        }
+        output_path = ContentStore::buildPath(config.output_dir, result.md5);
+    } else {
+        output_path = buildOutputPath(config.output_dir, result.filepath);
+    }
+
+    bool success = false;
+    result.phash = ImageProcessor::processEncodedImage(
+        data, length, result.filepath,
+        output_path.c_str(), config.thumbnail_size, success
+    );
+    result.success = success;
+
+    if (success && exact_duplicates) {
+        // Empty unless the prefilter found a same-size file with the same ends
+        result.md5 = getKnownDigest(result.order);
+        if (result.md5.empty() && full_digests) {
+            result.md5 = HashCalculator::calculateMD5(data, length);
+        }
+    } else if (success && !content_hashes) {
+        result.md5 = HashCalculator::calculateMD5(data, length);
+    }
+    return success;
+}
+
+void ThumbnailPipeline::resolveDuplicates() {
+    // Skipped files take the perceptual hash and outcome of the file they
+    // duplicate, which is only known once everything has finished
+    std::unordered_map<std::string, const ImageResult*> canonical;
+    for (const auto& results : worker_results) {
+        for (const auto& result : results) {
+            if (result.duplicate_of.empty()) {
+                canonical.emplace(result.filepath, &result);
+            }
+        }
+    }
+
+    for (auto& results : worker_results) {
+        for (auto& result : results) {
+            if (result.duplicate_of.empty() || !result.success) {
+                continue;
+            }
+            auto it = canonical.find(result.duplicate_of);
+            if (it != canonical.end() && it->second->success) {
+                result.phash = it->second->phash;
+                notifyCompleted(result);
+            } else {
+                result.success = false;
+                success_count.fetch_sub(1, std::memory_order_relaxed);
+                failure_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void ThumbnailPipeline::linkDuplicateOutputs() {
+    std::vector<const ImageResult*> duplicates;
+    for (const auto& results : worker_results) {
+        for (const auto& result : results) {
+            if (result.success && !result.duplicate_of.empty()) {
+                duplicates.push_back(&result);
+            }
+        }
+    }
+
+    // One thumbnail was written per content hash; the copies link to it
+    TaskGroup link_group;
+    scheduler.parallelFor(0, duplicates.size(), 16, [this, &duplicates](int64_t i) {
+        ScratchArena::Scope scratch(ScratchArena::local());
+        ArenaString target = buildOutputPath(config.output_dir, duplicates[i]->duplicate_of);
+        ArenaString link_path = buildOutputPath(config.output_dir, duplicates[i]->filepath);
+        if (OutputLinker::link(std::string(target.data(), target.size()),
+                               std::string(link_path.data(), link_path.size()),
+                               config.duplicate_output)) {
+            linked_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }, TaskScheduler::Priority::Normal, link_group);
+    scheduler.wait(link_group);
+}
+
+void ThumbnailPipeline::finishPackedOutput() {
+    // Duplicates were never stored; index them under their original
+    for (const auto& results : worker_results) {
+        for (const auto& result : results) {
+            if (result.success && !result.duplicate_of.empty()) {
+                if (archive) {
+                    archive->addAlias(result.filepath, result.duplicate_of);
+                } else {
+                    atlas->addAlias(result.filepath, result.duplicate_of);
+                }
+            }
+        }
+    }
+    if (archive) {
+        archive->finish();
+    } else {
+        atlas->finish();
+    }
+}
+
+std::vector<ThumbnailPipeline::ImageResult> ThumbnailPipeline::collectResults() const {
+    std::vector<ImageResult> all;
+    for (const auto& results : worker_results) {
+        all.insert(all.end(), results.begin(), results.end());
+    }
+
+    std::sort(all.begin(), all.end(), [](const ImageResult& a, const ImageResult& b) {
+        if (a.order != b.order) {
+            return a.order < b.order;
+        }
+        return a.filepath < b.filepath;
+    });
+    return all;
+}
+
+int ThumbnailPipeline::getSuccessCount() const {
+    return success_count.load(std::memory_order_relaxed);
+}
+
+int ThumbnailPipeline::getFailureCount() const {
+    return failure_count.load(std::memory_order_relaxed);
+}
+
+int ThumbnailPipeline::getSkippedCount() const {
+    return skipped_count.load(std::memory_order_relaxed);
+}
+
+int ThumbnailPipeline::getLinkedCount() const {
+    return linked_count.load(std::memory_order_relaxed);
+}
+
+ArenaString ThumbnailPipeline::buildOutputPath(const std::string& output_dir, const std::string& filepath) {
+    size_t name_start = filepath.find_last_of("/\\");
+    name_start = (name_start == std::string::npos) ? 0 : name_start + 1;
+    size_t name_end = filepath.find_last_of('.');
+    if (name_end == std::string::npos || name_end <= name_start) {
+        name_end = filepath.size();
+    }
+
+    ArenaString output_path;
+    output_path.reserve(output_dir.size() + (name_end - name_start) + 11);
+    output_path.append(output_dir.data(), output_dir.size());
+    if (!output_dir.empty() && output_dir.back() != '/' && output_dir.back() != '\\') {
+        output_path.push_back('/');
+    }
+    output_path.append(filepath, name_start, name_end - name_start);
+    output_path.append("_thumb.jpg");
+    return output_path;
+}
@@ -0,0 +1,167 @@
+#ifndef THUMBNAIL_PIPELINE_H
+#define THUMBNAIL_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "async_reader.h"
+#include "atlas_builder.h"
+#include "buffer_pool.h"
+#include "config.h"
+#include "content_hash_set.h"
+#include "exact_duplicate_finder.h"
+#include "scratch_arena.h"
+#include "task_scheduler.h"
+#include "thumbnail_archive.h"
+
+// Per-image work of the parallel mode: thumbnail, perceptual hash and
+// content hash, run as tasks on a TaskScheduler. Images can be queued from
+// any thread while processing is already under way. With a reader backend
+// configured, files are first read into pooled buffers by an AsyncReader
+// and workers only decode and hash from memory; with the mmap reader each
+// worker decodes and hashes straight from a read-only mapping of its file.
+class ThumbnailPipeline {
+public:
+    struct ImageResult {
+        std::string filepath;
+        std::string md5;
+        uint64_t phash;
+        uint64_t order;  // Sort key for deterministic result order
+        int64_t file_size;  // -1 if not known up front
+        std::string duplicate_of;  // Byte-identical file whose thumbnail is reused
+        bool success;
+    };
+
+    // Receives each successfully processed image; runs on a worker
+    using CompletionListener = std::function<void(const ImageResult& result)>;
+
+    ThumbnailPipeline(const Config& config, TaskScheduler& scheduler);
+    ~ThumbnailPipeline();
+
+    ThumbnailPipeline(const ThumbnailPipeline&) = delete;
+    ThumbnailPipeline& operator=(const ThumbnailPipeline&) = delete;
+
+    // Queue one image; safe to call from any thread, including workers
+    void submit(std::string filepath, uint64_t order = 0, int64_t file_size = -1);
+
+    // Queue a whole list, split recursively across the workers.
+    // The list must stay alive until wait() returns.
+    void submitAll(const std::vector<std::string>& image_files);
+
+    // Queue a list strictly in order from the calling thread, keeping at
+    // most prefetch_window images in flight and hinting readahead for the
+    // files just behind them. Returns once the last image is queued.
+    void submitInOrder(const std::vector<std::string>& image_files, int prefetch_window);
+
+    // Use the outcome of an up-front ExactDuplicateFinder pass, indexed by
+    // submission order: known duplicates are neither read nor decoded and
+    // other files take their digest from it instead of hashing again.
+    // Replaces the hash-first check; call before submitting.
+    void setExactDuplicates(ExactDuplicateFinder::Result duplicates);
+
+    // Also hash in full the files the up-front pass left without a digest
+    // (unique sizes), for hashes that outlive this run's duplicate search
+    void setFullDigests(bool full);
+
+    // Report images as they complete, once their hashes are final. Skipped
+    // exact duplicates are only settled, and reported, by wait(). Call
+    // before submitting; the listener must be thread safe.
+    void setCompletionListener(CompletionListener listener);
+
+    // Whether results are kept for collectResults() (the default). Without
+    // them each image is dropped once reported to the completion listener,
+    // so memory is bounded by the images in flight. --skip-exact-dups and
+    // the packed layouts settle duplicates from the kept results, so they
+    // always keep them. Call before submitting.
+    void setKeepResults(bool keep);
+
+    // Group that image tasks belong to (producers may add their own tasks)
+    TaskGroup& getGroup();
+
+    // Block until every queued image has been processed
+    void wait();
+
+    // Block until at most max_in_flight queued images are unfinished;
+    // lets producers bound how far they run ahead of the workers
+    void waitForBacklog(int64_t max_in_flight);
+
+    // All results, ordered by (order, filepath)
+    std::vector<ImageResult> collectResults() const;
+
+    // Reader actually in use (may differ from the configured one after a fallback)
+    ReaderBackend getReaderBackend() const;
+
+    int getSuccessCount() const;
+    int getFailureCount() const;
+
+    // Images skipped as exact duplicates (--skip-exact-dups)
+    int getSkippedCount() const;
+
+    // Duplicate thumbnails created as links (--dup-output)
+    int getLinkedCount() const;
+
+    // Build "<output_dir>/<stem>_thumb.jpg" in the calling thread's scratch arena
+    static ArenaString buildOutputPath(const std::string& output_dir, const std::string& filepath);
+
+private:
+    ImageResult& beginImage(std::string filepath, uint64_t order, int64_t file_size);
+    void finishImage(bool success);
+    // Done with result: finished and, if successful, reported
+    void releaseImage(ImageResult& result);
+    void notifyCompleted(const ImageResult& result);
+
+    // Dispatch on the configured reader for images read inside the worker
+    void processFile(std::string filepath, uint64_t order, int64_t file_size);
+    void processImage(std::string filepath, uint64_t order, int64_t file_size);
+    void processMapped(std::string filepath, uint64_t order, int64_t file_size);
+    void processRead(std::string filepath, uint64_t order, int64_t file_size);
+    void processBuffer(AsyncReader::Request request, BufferPool::Buffer* buffer);
+
+    // Thumbnail and hashes from in-memory file contents; returns success
+    bool processContents(ImageResult& result, const unsigned char* data, size_t length);
+    void resolveDuplicates();
+    void linkDuplicateOutputs();
+    void finishPackedOutput();
+
+    bool isKnownDuplicate(uint64_t order) const;
+    std::string getKnownDigest(uint64_t order) const;
+
+    const Config& config;
+    TaskScheduler& scheduler;
+    TaskGroup group;
+
+    // One result list per worker; deque keeps elements in place while the
+    // owning worker appends, so child tasks can fill them in later
+    std::vector<std::deque<ImageResult>> worker_results;
+    bool keep_results;  // Otherwise results are heap allocated per image
+    bool full_digests;
+
+    std::atomic<int> success_count;
+    std::atomic<int> failure_count;
+    std::atomic<int> skipped_count;
+    std::atomic<int> linked_count;
+
+    std::atomic<int64_t> in_flight;
+    std::atomic<bool> backlog_waiting;
+    std::mutex backlog_mutex;
+    std::condition_variable backlog_cv;
+
+    CompletionListener completion_listener;
+
+    std::unique_ptr<ContentHashSet> content_hashes;  // Only with --skip-exact-dups
+    std::unique_ptr<ExactDuplicateFinder::Result> exact_duplicates;
+    std::unique_ptr<ArchiveWriter> archive;  // Only with --layout archive
+    std::unique_ptr<AtlasBuilder> atlas;     // Only with --layout atlas
+
+    std::unique_ptr<BufferPool> buffer_pool;
+    std::unique_ptr<AsyncReader> reader;
+};
+
+#endif // THUMBNAIL_PIPELINE_H
@@ -0,0 +1,167 @@
+#include "thumbnail_service.h"
+
+#include <algorithm>
+#include <iostream>
+
+ThumbnailService::ThumbnailService(int num_threads, size_t capacity, size_t chunk_size)
+    : capacity(std::max<size_t>(capacity, 1)),
+      chunk_size(std::max<size_t>(chunk_size, 1)),
+      owned_scheduler(new TaskScheduler(num_threads)),
+      scheduler(*owned_scheduler),
+      pending(0),
+      active_drainers(0) {
+}
+
+ThumbnailService::ThumbnailService(TaskScheduler& scheduler, size_t capacity, size_t chunk_size)
+    : capacity(std::max<size_t>(capacity, 1)),
+      chunk_size(std::max<size_t>(chunk_size, 1)),
+      scheduler(scheduler),
+      pending(0),
+      active_drainers(0) {
+}
+
+ThumbnailService::~ThumbnailService() {
+    // Drain tasks keep going until the queue is empty
+    scheduler.wait(group);
+}
+
+std::future<std::vector<ThumbnailService::ItemResult>> ThumbnailService::submit(std::vector<Input> batch,
+                                                                                  int thumbnail_size) {
+    auto entry = std::make_shared<Batch>();
+    entry->inputs = std::move(batch);
+    entry->thumbnail_size = thumbnail_size;
+    std::future<std::vector<ItemResult>> result = entry->promise.get_future();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    space_cv.wait(lock, [&] { return fits(entry->inputs.size()); });
+    enqueue(lock, std::move(entry));
+    return result;
+}
+
+void ThumbnailService::submit(std::vector<Input> batch, int thumbnail_size, Callback callback) {
+    auto entry = std::make_shared<Batch>();
+    entry->inputs = std::move(batch);
+    entry->thumbnail_size = thumbnail_size;
+    entry->callback = std::move(callback);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    space_cv.wait(lock, [&] { return fits(entry->inputs.size()); });
+    enqueue(lock, std::move(entry));
+}
+
+bool ThumbnailService::trySubmit(std::vector<Input> batch, int thumbnail_size, Callback callback) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!fits(batch.size())) {
+        return false;
+    }
+
+    auto entry = std::make_shared<Batch>();
+    entry->inputs = std::move(batch);
+    entry->thumbnail_size = thumbnail_size;
+    entry->callback = std::move(callback);
+    enqueue(lock, std::move(entry));
+    return true;
+}
+
+size_t ThumbnailService::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+int ThumbnailService::getThreadCount() const {
+    return scheduler.getThreadCount();
+}
+
+bool ThumbnailService::fits(size_t count) const {
+    return pending == 0 || pending + count <= capacity;
+}
+
+void ThumbnailService::enqueue(std::unique_lock<std::mutex>& lock, std::shared_ptr<Batch> batch) {
+    size_t count = batch->inputs.size();
+    batch->results.resize(count);
+    batch->remaining = count;
+
+    if (count == 0) {
+        lock.unlock();
+        complete(*batch);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        queue.push_back(Item{batch, i});
+    }
+    pending += count;
+
+    // One drain task per chunk waiting, up to one per worker; running
+    // drainers pick up whatever is queued after them
+    size_t chunks = (queue.size() + chunk_size - 1) / chunk_size;
+    int wanted = static_cast<int>(std::min<size_t>(chunks, scheduler.getThreadCount()));
+    for (; active_drainers < wanted; active_drainers++) {
+        scheduler.submit([this]() { drain(); }, TaskScheduler::Priority::Normal, &group);
+    }
+}
+
+void ThumbnailService::drain() {
+    std::vector<Item> chunk;
+    std::vector<std::shared_ptr<Batch>> finished;
+    chunk.reserve(chunk_size);
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.empty()) {
+                active_drainers--;
+                return;
+            }
+            size_t take = std::min(chunk_size, queue.size());
+            for (size_t i = 0; i < take; i++) {
+                chunk.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        for (Item& item : chunk) {
+            Batch& batch = *item.batch;
+            const Input& input = batch.inputs[item.index];
+            ItemResult& out = batch.results[item.index];
+
+            Thumbnailer::Result result = Thumbnailer::generate(input.data, input.length,
+                                                               batch.thumbnail_size, out.jpeg);
+            out.status = result.status;
+            out.width = result.width;
+            out.height = result.height;
+            out.perceptual_hash = result.perceptual_hash;
+            out.content_hash = result.content_hash;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (Item& item : chunk) {
+                if (--item.batch->remaining == 0) {
+                    finished.push_back(std::move(item.batch));
+                }
+            }
+            pending -= chunk.size();
+        }
+        space_cv.notify_all();
+        chunk.clear();
+
+        // Outside the lock: a callback may trySubmit the next batch
+        for (auto& batch : finished) {
+            complete(*batch);
+        }
+        finished.clear();
+    }
+}
+
+void ThumbnailService::complete(Batch& batch) {
+    if (!batch.callback) {
+        batch.promise.set_value(std::move(batch.results));
+        return;
+    }
+    try {
+        batch.callback(batch.results);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: thumbnail batch callback failed: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef THUMBNAIL_SERVICE_H
+#define THUMBNAIL_SERVICE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "task_scheduler.h"
+#include "thumbnailer.h"
+
+// Asynchronous batch front end of libthumbnail. Callers hand over batches
+// of encoded images and get the thumbnails back through a future or a
+// callback. Items of all batches wait in one bounded FIFO; a few drain
+// tasks on a private TaskScheduler take them off in chunks, so many small
+// requests are coalesced into the same worker chunks instead of each
+// paying for its own task. Submitting blocks while the queue is full.
+class ThumbnailService {
+public:
+    // Encoded image; the bytes are not copied and must stay alive until
+    // the batch has completed
+    struct Input {
+        const unsigned char* data;
+        size_t length;
+    };
+
+    struct ItemResult {
+        Thumbnailer::Status status;
+        std::vector<unsigned char> jpeg;
+        int width;
+        int height;
+        uint64_t perceptual_hash;
+        std::string content_hash;
+    };
+
+    // Receives the results of a batch, in input order. It runs on a worker
+    // that may be the only one draining the queue, so it must chain further
+    // batches with trySubmit: a blocking submit there can wait forever for
+    // space that only this worker would free.
+    using Callback = std::function<void(std::vector<ItemResult>& results)>;
+
+    // capacity bounds the number of queued and running items across all
+    // batches; chunk_size is the number of items a worker takes at a time
+    ThumbnailService(int num_threads, size_t capacity = 1024, size_t chunk_size = 8);
+
+    // Same, running on an existing scheduler shared with other work
+    explicit ThumbnailService(TaskScheduler& scheduler, size_t capacity = 1024, size_t chunk_size = 8);
+
+    // Finishes every submitted batch before returning
+    ~ThumbnailService();
+
+    ThumbnailService(const ThumbnailService&) = delete;
+    ThumbnailService& operator=(const ThumbnailService&) = delete;
+
+    // Queue a batch, blocking while it does not fit. A batch larger than
+    // the capacity is admitted once the service is otherwise idle. Not for
+    // use from the scheduler's workers, callbacks included (see Callback).
+    std::future<std::vector<ItemResult>> submit(std::vector<Input> batch, int thumbnail_size);
+    void submit(std::vector<Input> batch, int thumbnail_size, Callback callback);
+
+    // Same as submit with a callback, but returns false instead of
+    // blocking if the batch does not fit right now
+    bool trySubmit(std::vector<Input> batch, int thumbnail_size, Callback callback);
+
+    // Items queued or being processed
+    size_t getPendingCount() const;
+
+    int getThreadCount() const;
+
+private:
+    struct Batch {
+        std::vector<Input> inputs;
+        std::vector<ItemResult> results;
+        int thumbnail_size;
+        size_t remaining;  // Guarded by the service mutex
+        std::promise<std::vector<ItemResult>> promise;
+        Callback callback;  // Empty when the promise is used
+    };
+
+    struct Item {
+        std::shared_ptr<Batch> batch;
+        size_t index;
+    };
+
+    bool fits(size_t count) const;
+    void enqueue(std::unique_lock<std::mutex>& lock, std::shared_ptr<Batch> batch);
+    void drain();
+    static void complete(Batch& batch);
+
+    const size_t capacity;
+    const size_t chunk_size;
+
+    std::unique_ptr<TaskScheduler> owned_scheduler;
+    TaskScheduler& scheduler;
+    TaskGroup group;
+
+    mutable std::mutex mutex;
+    std::condition_variable space_cv;
+    std::deque<Item> queue;
+    size_t pending;       // Items queued or running
+    int active_drainers;  // Drain tasks submitted and not yet finished
+};
+
+#endif // THUMBNAIL_SERVICE_H
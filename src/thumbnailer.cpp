@@ -0,0 +1,79 @@
+#include "thumbnailer.h"
+#include "hash_calculator.h"
+#include "image_processor.h"
+
+namespace {
+    Thumbnailer::Result emptyResult() {
+        Thumbnailer::Result result;
+        result.status = Thumbnailer::Status::DecodeFailed;
+        result.jpeg_size = 0;
+        result.width = 0;
+        result.height = 0;
+        result.perceptual_hash = 0;
+        result.content_hash[0] = '\0';
+        return result;
+    }
+}
+
+Thumbnailer::Result Thumbnailer::generate(const unsigned char* encoded, size_t length, int thumbnail_size,
+                                          unsigned char* jpeg_out, size_t jpeg_capacity) {
+    Result result = emptyResult();
+    HashCalculator::calculateMD5(encoded, length, result.content_hash);
+
+    bool success = false;
+    result.perceptual_hash = ImageProcessor::processEncodedImage(
+        encoded, length, "<memory>", thumbnail_size,
+        [&result, jpeg_out, jpeg_capacity](const ImageProcessor::ImageData& thumbnail) {
+            result.width = thumbnail.width;
+            result.height = thumbnail.height;
+            if (!ImageProcessor::encodeThumbnail(thumbnail, jpeg_out, jpeg_capacity, result.jpeg_size)) {
+                result.status = Status::EncodeFailed;
+                return false;
+            }
+            result.status = result.jpeg_size > jpeg_capacity ? Status::BufferTooSmall : Status::Ok;
+            return result.status == Status::Ok;
+        }, success
+    );
+
+    if (result.status != Status::Ok && result.status != Status::BufferTooSmall) {
+        result.jpeg_size = 0;
+    }
+    return result;
+}
+
+Thumbnailer::Result Thumbnailer::generate(const unsigned char* encoded, size_t length, int thumbnail_size,
+                                          std::vector<unsigned char>& jpeg_out) {
+    Result result = emptyResult();
+    HashCalculator::calculateMD5(encoded, length, result.content_hash);
+
+    ImageProcessor::EncodedThumbnail encoded_thumbnail;
+    encoded_thumbnail.jpeg.swap(jpeg_out);  // Reuse the caller's capacity
+    bool success = false;
+    result.perceptual_hash = ImageProcessor::processEncodedImage(
+        encoded, length, "<memory>", thumbnail_size,
+        [&result, &encoded_thumbnail](const ImageProcessor::ImageData& thumbnail) {
+            result.width = thumbnail.width;
+            result.height = thumbnail.height;
+            result.status = ImageProcessor::encodeThumbnail(thumbnail, encoded_thumbnail)
+                ? Status::Ok : Status::EncodeFailed;
+            return result.status == Status::Ok;
+        }, success
+    );
+    jpeg_out.swap(encoded_thumbnail.jpeg);
+
+    if (result.status != Status::Ok) {
+        jpeg_out.clear();
+    }
+    result.jpeg_size = jpeg_out.size();
+    return result;
+}
+
+const char* Thumbnailer::getStatusMessage(Status status) {
+    switch (status) {
+        case Status::Ok: return "ok";
+        case Status::DecodeFailed: return "image could not be decoded";
+        case Status::EncodeFailed: return "thumbnail could not be encoded";
+        case Status::BufferTooSmall: return "output buffer too small";
+    }
+    return "unknown status";
+}
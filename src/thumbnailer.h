@@ -0,0 +1,43 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Embeddable entry point of libthumbnail: encoded image bytes in, JPEG
+// thumbnail and hashes out, all in caller-provided memory. Never touches
+// the file system; the input is decoded in place and the thumbnail is
+// encoded straight into the caller's buffer. Safe to call concurrently.
+class Thumbnailer {
+public:
+    enum class Status {
+        Ok,
+        DecodeFailed,    // Not a supported image, or resizing failed
+        EncodeFailed,
+        BufferTooSmall,  // jpeg_size holds the capacity needed
+    };
+
+    struct Result {
+        Status status;
+        size_t jpeg_size;          // Bytes written to jpeg_out
+        int width;                 // Thumbnail dimensions
+        int height;
+        uint64_t perceptual_hash;  // dHash of the full image
+        char content_hash[33];     // Hex digest of the input bytes, NUL-terminated
+    };
+
+    // Longest side of the thumbnail is thumbnail_size pixels. The hashes
+    // are filled in whenever the input decodes, even if encoding fails.
+    static Result generate(const unsigned char* encoded, size_t length, int thumbnail_size,
+                           unsigned char* jpeg_out, size_t jpeg_capacity);
+
+    // Same, encoding into jpeg_out (replacing its contents, reusing its
+    // capacity); never returns BufferTooSmall
+    static Result generate(const unsigned char* encoded, size_t length, int thumbnail_size,
+                           std::vector<unsigned char>& jpeg_out);
+
+    static const char* getStatusMessage(Status status);
+};
+
+#endif // THUMBNAILER_H